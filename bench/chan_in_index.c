@@ -0,0 +1,100 @@
+/** @file chan_in_index.c
+ *  @brief Micro-benchmark: CHAN_IN over 1-5 sources, scan vs indexed lookup
+ *
+ *  For each number of sources, times three ways of finding the latest value:
+ *    variadic  chan_in(), the original generic path (diagnostics builds)
+ *    scan      inline compare of all source timestamps
+ *    indexed   CHAN_INn, through the latest-writer index
+ *  and prints one line per measurement, together with the number of
+ *  non-volatile metadata reads each method does per lookup.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+
+#define ITERATIONS 10000000UL
+
+struct msg_x {
+    CHAN_FIELD(unsigned, x);
+};
+
+TASK(1, task_bench)
+
+CHANNEL(src0, task_bench, msg_x);
+CHANNEL(src1, task_bench, msg_x);
+CHANNEL(src2, task_bench, msg_x);
+CHANNEL(src3, task_bench, msg_x);
+CHANNEL(src4, task_bench, msg_x);
+
+#define C0 CH(src0, task_bench)
+#define C1 CH(src1, task_bench)
+#define C2 CH(src2, task_bench)
+#define C3 CH(src3, task_bench)
+#define C4 CH(src4, task_bench)
+#define OFF(chan) offsetof(__typeof__((chan)->data), x)
+#define VAR_SIZE sizeof(VAR_TYPE(unsigned))
+
+// Keep the compiler from hoisting the metadata loads out of the loop
+#define BARRIER() __asm__ volatile ("" ::: "memory")
+
+#define SCAN1 CHAN_VAR_IN(unsigned, x, C0)
+#define SCAN2 chan_var_latest(SCAN1, CHAN_VAR_IN(unsigned, x, C1))
+#define SCAN3 chan_var_latest(SCAN2, CHAN_VAR_IN(unsigned, x, C2))
+#define SCAN4 chan_var_latest(SCAN3, CHAN_VAR_IN(unsigned, x, C3))
+#define SCAN5 chan_var_latest(SCAN4, CHAN_VAR_IN(unsigned, x, C4))
+
+#define TIME(sources, method, reads, expr) \
+    do { \
+        unsigned long sum = 0; \
+        uint64_t start = host_time_ns(); \
+        for (unsigned long i = 0; i < ITERATIONS; ++i) { \
+            sum += *(unsigned *)(expr); \
+            BARRIER(); \
+        } \
+        double ns = (double)(host_time_ns() - start) / ITERATIONS; \
+        printf("chan_in sources=%u method=%s nv_reads=%u ns_per_op=%.2f check=%lu\n", \
+               sources, method, reads, ns, sum); \
+    } while (0)
+
+void init() {}
+
+void task_bench()
+{
+    unsigned val;
+
+    // Source 0 is written last, so that it is the indexed one
+    val = 14; CHAN_OUT1(unsigned, x, val, C4);
+    val = 13; CHAN_OUT1(unsigned, x, val, C3);
+    val = 12; CHAN_OUT1(unsigned, x, val, C2);
+    val = 11; CHAN_OUT1(unsigned, x, val, C1);
+    val = 10; CHAN_OUT1(unsigned, x, val, C0);
+
+    TIME(1, "variadic", 1, chan_in("x", VAR_SIZE, 1, C0, OFF(C0)));
+    TIME(1, "scan", 0, CHAN_VAR_VALUE(unsigned, SCAN1));
+    TIME(1, "indexed", 0, CHAN_IN1(unsigned, x, C0));
+
+    TIME(2, "variadic", 2, chan_in("x", VAR_SIZE, 2, C0, OFF(C0), C1, OFF(C1)));
+    TIME(2, "scan", 2, CHAN_VAR_VALUE(unsigned, SCAN2));
+    TIME(2, "indexed", 1, CHAN_IN2(unsigned, x, C0, C1));
+
+    TIME(3, "variadic", 3, chan_in("x", VAR_SIZE, 3, C0, OFF(C0), C1, OFF(C1),
+                                   C2, OFF(C2)));
+    TIME(3, "scan", 3, CHAN_VAR_VALUE(unsigned, SCAN3));
+    TIME(3, "indexed", 1, CHAN_IN3(unsigned, x, C0, C1, C2));
+
+    TIME(4, "variadic", 4, chan_in("x", VAR_SIZE, 4, C0, OFF(C0), C1, OFF(C1),
+                                   C2, OFF(C2), C3, OFF(C3)));
+    TIME(4, "scan", 4, CHAN_VAR_VALUE(unsigned, SCAN4));
+    TIME(4, "indexed", 1, CHAN_IN4(unsigned, x, C0, C1, C2, C3));
+
+    TIME(5, "variadic", 5, chan_in("x", VAR_SIZE, 5, C0, OFF(C0), C1, OFF(C1),
+                                   C2, OFF(C2), C3, OFF(C3), C4, OFF(C4)));
+    TIME(5, "scan", 5, CHAN_VAR_VALUE(unsigned, SCAN5));
+    TIME(5, "indexed", 1, CHAN_IN5(unsigned, x, C0, C1, C2, C3, C4));
+
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_bench)
@@ -0,0 +1,276 @@
+/** @file hotpath.c
+ *  @brief Micro-benchmark suite: the hot paths of the runtime, one at a time
+ *
+ *  HOTPATH_OP selects what to measure and HOTPATH_N its size:
+ *
+ *      transition     TRANSITION_TO a task, single-threaded
+ *      transition_mt  TRANSITION_TO_MT with N threads (1..MAX_NUM_THREADS),
+ *                     i.e. the scheduler, which runs in every boundary
+ *      prologue       task boundary after writing N (0..MAX_FIELDS) fields
+ *                     of a self channel, which the prologue commits
+ *      chan_in        CHAN_INn over N (1..5) sources
+ *      chan_out_t2t   CHAN_OUT1 to a T2T channel
+ *      chan_out_self  CHAN_OUT1 to a self channel
+ *      mutex          mutex_lock and mutex_unlock, uncontended
+ *      mutex_contended  the same with N (2..MAX_NUM_THREADS) threads that
+ *                     take turns on one mutex, each one blocking on it
+ *
+ *  and prints one line
+ *
+ *      hotpath op=OP n=N ns_per_op=X nv_bytes_per_op=Y
+ *
+ *  An iteration is one task execution, or one acquisition of the mutex for
+ *  mutex_contended, and does one or more operations; the task boundary is
+ *  included, spread over the operations of the iteration. nv_bytes_per_op
+ *  is the number of bytes of non-volatile memory that one iteration changed
+ *  (see host_nv_changed), per operation. `make bench-run` runs every case.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+
+#define WARMUP      1000UL
+#define ITERATIONS  1000000UL   // HOTPATH_ITERATIONS overrides
+#define MAX_FIELDS  16
+#define OUT_FIELDS  16          // distinct fields written per iteration
+#define IN_OPS      64
+#define MUTEX_PAIRS 4           // each pair takes four undo log entries
+
+#define BARRIER() __asm__ volatile ("" ::: "memory")
+
+// Written values change in all bytes, so that nv_bytes_per_op sees them
+#define VALUE(i) ((unsigned)(i) * 2654435761U)
+
+struct msg_x {
+    CHAN_FIELD(unsigned, x);
+};
+
+struct msg_out {
+    CHAN_FIELD_ARRAY(unsigned, v, OUT_FIELDS);
+};
+
+struct msg_self {
+    SELF_CHAN_FIELD_ARRAY(unsigned, v, MAX_FIELDS);
+};
+#define FIELD_INIT_msg_self { SELF_FIELD_ARRAY_INITIALIZER(MAX_FIELDS) }
+
+TASK(1, task_init)
+TASK(2, task_transition)
+TASK(3, task_transition_mt)
+TASK(4, task_dirty)
+TASK(5, task_chan_in)
+TASK(6, task_chan_out_t2t)
+TASK(7, task_chan_out_self)
+TASK(8, task_mutex)
+TASK(9, task_mutex_lock)
+TASK(10, task_mutex_cs)
+
+CHANNEL(src0, task_chan_in, msg_x);
+CHANNEL(src1, task_chan_in, msg_x);
+CHANNEL(src2, task_chan_in, msg_x);
+CHANNEL(src3, task_chan_in, msg_x);
+CHANNEL(src4, task_chan_in, msg_x);
+CHANNEL(task_chan_out_t2t, sink, msg_out);
+SELF_CHANNEL(task_dirty, msg_self);
+SELF_CHANNEL(task_chan_out_self, msg_self);
+
+#define C0 CH(src0, task_chan_in)
+#define C1 CH(src1, task_chan_in)
+#define C2 CH(src2, task_chan_in)
+#define C3 CH(src3, task_chan_in)
+#define C4 CH(src4, task_chan_in)
+
+__nv mutex_t bench_mutex;
+
+static const char *op;
+static unsigned n;
+static unsigned long num_iterations;
+static unsigned long iterations;
+static size_t nv_bytes;
+static uint64_t start_ns;
+static volatile unsigned long check;  // keeps the reads
+
+void init()
+{
+    const char *env = getenv("HOTPATH_OP");
+    op = env ? env : "transition";
+
+    env = getenv("HOTPATH_N");
+    n = env ? strtoul(env, NULL, 0) : 1;
+
+    env = getenv("HOTPATH_ITERATIONS");
+    num_iterations = env ? strtoul(env, NULL, 0) : ITERATIONS;
+    if (!num_iterations)
+        num_iterations = 1;
+}
+
+/** @brief Start of an iteration that does the given number of operations */
+static void iteration(unsigned ops)
+{
+    if (iterations == WARMUP) {
+        host_nv_snapshot();
+        start_ns = host_time_ns();
+    } else if (iterations == WARMUP + 1) {
+        nv_bytes = host_nv_changed();
+    } else if (iterations == WARMUP + num_iterations) {
+        double ns = host_time_ns() - start_ns;
+
+        printf("hotpath op=%s n=%u ns_per_op=%.2f nv_bytes_per_op=%.2f\n",
+               op, n, ns / ((double)num_iterations * ops),
+               (double)nv_bytes / ops);
+        exit(0);
+    }
+    ++iterations;
+}
+
+static void start_threads(unsigned count, task_t *task)
+{
+    if (count < 1)
+        count = 1;
+    if (count > MAX_NUM_THREADS)
+        count = MAX_NUM_THREADS;
+    n = count;
+
+    thread_init();
+    for (unsigned i = 1; i < count; ++i)
+        thread_create(task);
+    transition_to_mt(task);
+}
+
+void task_init()
+{
+    unsigned val;
+
+    if (!strcmp(op, "transition"))
+        TRANSITION_TO(task_transition);
+    if (!strcmp(op, "transition_mt"))
+        start_threads(n, TASK_REF(task_transition_mt));
+    if (!strcmp(op, "prologue")) {
+        if (n > MAX_FIELDS)
+            n = MAX_FIELDS;
+        TRANSITION_TO(task_dirty);
+    }
+    if (!strcmp(op, "chan_in")) {
+        if (n < 1 || n > 5)
+            n = 1;
+        // Source 0 is written last, so that it is the indexed one
+        val = 14; CHAN_OUT1(unsigned, x, val, C4);
+        val = 13; CHAN_OUT1(unsigned, x, val, C3);
+        val = 12; CHAN_OUT1(unsigned, x, val, C2);
+        val = 11; CHAN_OUT1(unsigned, x, val, C1);
+        val = 10; CHAN_OUT1(unsigned, x, val, C0);
+        TRANSITION_TO(task_chan_in);
+    }
+    if (!strcmp(op, "chan_out_t2t"))
+        TRANSITION_TO(task_chan_out_t2t);
+    if (!strcmp(op, "chan_out_self"))
+        TRANSITION_TO(task_chan_out_self);
+    if (!strcmp(op, "mutex")) {
+        mutex_init(&bench_mutex);
+        TRANSITION_TO(task_mutex);
+    }
+    if (!strcmp(op, "mutex_contended")) {
+        mutex_init(&bench_mutex);
+        start_threads(n < 2 ? 2 : n, TASK_REF(task_mutex_lock));
+    }
+
+    printf("hotpath: unknown op '%s'\n", op);
+    exit(1);
+}
+
+void task_transition()
+{
+    iteration(1);
+    TRANSITION_TO(task_transition);
+}
+
+void task_transition_mt()
+{
+    iteration(1);
+    TRANSITION_TO_MT(task_transition_mt);
+}
+
+void task_dirty()
+{
+    unsigned val = VALUE(iterations);
+
+    iteration(1);
+
+    for (unsigned i = 0; i < n; ++i)
+        CHAN_OUT1(unsigned, v[i], val, SELF_OUT_CH(task_dirty));
+    TRANSITION_TO(task_dirty);
+}
+
+#define READ_LOOP(expr) \
+    for (unsigned i = 0; i < IN_OPS; ++i) { \
+        sum += *(expr); \
+        BARRIER(); \
+    }
+
+void task_chan_in()
+{
+    unsigned long sum = 0;
+
+    iteration(IN_OPS);
+    switch (n) {
+        case 1: READ_LOOP(CHAN_IN1(unsigned, x, C0)); break;
+        case 2: READ_LOOP(CHAN_IN2(unsigned, x, C0, C1)); break;
+        case 3: READ_LOOP(CHAN_IN3(unsigned, x, C0, C1, C2)); break;
+        case 4: READ_LOOP(CHAN_IN4(unsigned, x, C0, C1, C2, C3)); break;
+        case 5: READ_LOOP(CHAN_IN5(unsigned, x, C0, C1, C2, C3, C4)); break;
+    }
+    check += sum;
+    TRANSITION_TO(task_chan_in);
+}
+
+void task_chan_out_t2t()
+{
+    unsigned val = VALUE(iterations);
+
+    iteration(OUT_FIELDS);
+
+    for (unsigned i = 0; i < OUT_FIELDS; ++i)
+        CHAN_OUT1(unsigned, v[i], val, CH(task_chan_out_t2t, sink));
+    TRANSITION_TO(task_chan_out_t2t);
+}
+
+void task_chan_out_self()
+{
+    unsigned val = VALUE(iterations);
+
+    iteration(OUT_FIELDS);
+
+    for (unsigned i = 0; i < OUT_FIELDS; ++i)
+        CHAN_OUT1(unsigned, v[i], val, SELF_OUT_CH(task_chan_out_self));
+    TRANSITION_TO(task_chan_out_self);
+}
+
+void task_mutex()
+{
+    iteration(MUTEX_PAIRS);
+    for (unsigned i = 0; i < MUTEX_PAIRS; ++i) {
+        mutex_lock(&bench_mutex);
+        mutex_unlock(&bench_mutex);
+    }
+    TRANSITION_TO(task_mutex);
+}
+
+void task_mutex_lock()
+{
+    mutex_lock(&bench_mutex);
+    iteration(1);
+    TRANSITION_TO_MT(task_mutex_cs);
+}
+
+void task_mutex_cs()
+{
+    mutex_unlock(&bench_mutex);
+    TRANSITION_TO_MT(task_mutex_lock);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,112 @@
+/** @file load.c
+ *  @brief Host load generator: a mix of threads, each a chain of tasks
+ *
+ *  Every worker thread runs the three-task chain produce -> filter -> consume,
+ *  passing a sample over T2T channels and keeping a running sum in a self
+ *  channel. Run it under the host runtime, e.g.
+ *
+ *      CHAIN_MAX_TRANSITIONS=1000000 CHAIN_RESET_RANDOM=5000 ./load
+ *
+ *  LOAD_THREADS selects the number of threads (1..MAX_NUM_THREADS, default
+ *  MAX_NUM_THREADS); with LOAD_THREADS=0 the chain runs single-threaded.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+
+struct msg_sample {
+    CHAN_FIELD(unsigned, sample);
+};
+
+struct msg_sum_init {
+    CHAN_FIELD(unsigned, sum);
+};
+
+struct msg_sum {
+    SELF_CHAN_FIELD(unsigned, sum);
+};
+#define FIELD_INIT_msg_sum { \
+    SELF_FIELD_INITIALIZER \
+}
+
+TASK(1, task_init)
+TASK(2, task_produce)
+TASK(3, task_filter)
+TASK(4, task_consume)
+TASK(6, task_produce_st)
+
+CHANNEL(task_produce, task_filter, msg_sample);
+CHANNEL(task_filter, task_consume, msg_sample);
+CHANNEL(task_init, task_consume, msg_sum_init);
+SELF_CHANNEL(task_consume, msg_sum);
+
+static unsigned num_threads;
+
+void init()
+{
+    const char *env = getenv("LOAD_THREADS");
+    num_threads = env ? strtoul(env, NULL, 0) : MAX_NUM_THREADS;
+    if (num_threads > MAX_NUM_THREADS)
+        num_threads = MAX_NUM_THREADS;
+}
+
+void task_init()
+{
+    unsigned sum = 0;
+    CHAN_OUT1(unsigned, sum, sum, CH(task_init, task_consume));
+
+    if (!num_threads)
+        TRANSITION_TO(task_produce_st);
+
+    thread_init();
+    for (unsigned i = 1; i < num_threads; ++i)
+        THREAD_CREATE(task_produce);
+    TRANSITION_TO_MT(task_produce);
+}
+
+static void produce()
+{
+    unsigned sample = curctx->time * 2654435761U;
+    CHAN_OUT1(unsigned, sample, sample, CH(task_produce, task_filter));
+}
+
+void task_produce()
+{
+    produce();
+    TRANSITION_TO_MT(task_filter);
+}
+
+void task_produce_st()
+{
+    produce();
+    TRANSITION_TO(task_filter);
+}
+
+void task_filter()
+{
+    unsigned sample = *CHAN_IN1(unsigned, sample, CH(task_produce, task_filter));
+    sample = (sample >> 3) ^ (sample << 5);
+    CHAN_OUT1(unsigned, sample, sample, CH(task_filter, task_consume));
+    if (num_threads)
+        TRANSITION_TO_MT(task_consume);
+    else
+        TRANSITION_TO(task_consume);
+}
+
+void task_consume()
+{
+    unsigned sample = *CHAN_IN1(unsigned, sample, CH(task_filter, task_consume));
+    unsigned sum = *CHAN_IN2(unsigned, sum, CH(task_init, task_consume),
+                                            SELF_IN_CH(task_consume));
+    sum += sample;
+    CHAN_OUT1(unsigned, sum, sum, SELF_OUT_CH(task_consume));
+    if (num_threads)
+        TRANSITION_TO_MT(task_produce);
+    else
+        TRANSITION_TO(task_produce_st);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,125 @@
+/** @file rwlock_contention.c
+ *  @brief Benchmark: read-mostly shared state, rwlock_t against mutex_t
+ *
+ *  Thread 0 is a maintenance thread that updates the shared state once
+ *  every WRITE_EVERY iterations, the other threads only read it. A read or
+ *  an update holds the lock over CS_TASKS tasks, and every iteration ends
+ *  with one task outside of the lock. After OPS lock acquisitions, prints
+ *
+ *      rwlock mode=M ops=N blocked=B wait_mean=W wait_max=X ns_per_op=T
+ *
+ *  where blocked is the number of task executions that blocked on the
+ *  lock (and were executed again later), and wait is the number of task
+ *  boundaries from requesting the lock to holding it. RW_MODE selects
+ *  "rwlock" (default) or "mutex", which takes a mutex_t for reads too.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+#include "rwlock.h"
+
+#define OPS         1000000UL
+#define CS_TASKS    2
+#define WRITE_EVERY 8
+
+TASK(1, task_init)
+TASK(2, task_lock)
+TASK(3, task_critical)
+TASK(4, task_outside)
+
+__nv rwlock_t rwlock;
+__nv mutex_t mutex;
+
+static int use_mutex;
+static unsigned long ops;
+static unsigned long attempts;
+static unsigned long wait_sum;
+static unsigned long wait_max;
+static chain_time_t requested[MAX_NUM_THREADS];
+static unsigned iteration[MAX_NUM_THREADS];
+static unsigned cs_left[MAX_NUM_THREADS];
+static uint64_t start_ns;
+
+void init()
+{
+    const char *env = getenv("RW_MODE");
+    use_mutex = env && !strcmp(env, "mutex");
+}
+
+static int is_write(unsigned id)
+{
+    return id == 0 && iteration[id] % WRITE_EVERY == 0;
+}
+
+static void report()
+{
+    printf("rwlock mode=%s ops=%lu blocked=%lu wait_mean=%.2f wait_max=%lu "
+           "ns_per_op=%.1f\n", use_mutex ? "mutex" : "rwlock", ops,
+           attempts - ops, (double)wait_sum / ops, wait_max,
+           (double)(host_time_ns() - start_ns) / ops);
+    exit(0);
+}
+
+void task_init()
+{
+    rwlock_init(&rwlock);
+    mutex_init(&mutex);
+
+    thread_init();
+    for (unsigned i = 1; i < MAX_NUM_THREADS; ++i)
+        THREAD_CREATE(task_outside);
+
+    start_ns = host_time_ns();
+    TRANSITION_TO_MT(task_outside);
+}
+
+void task_lock()
+{
+    unsigned id = get_current();
+
+    attempts++;
+    if (use_mutex)
+        mutex_lock(&mutex);
+    else if (is_write(id))
+        rwlock_wrlock(&rwlock);
+    else
+        rwlock_rdlock(&rwlock);
+
+    unsigned long wait = curctx->time - requested[id];
+    wait_sum += wait;
+    if (wait > wait_max)
+        wait_max = wait;
+    if (++ops == OPS)
+        report();
+
+    cs_left[id] = CS_TASKS;
+    TRANSITION_TO_MT(task_critical);
+}
+
+void task_critical()
+{
+    unsigned id = get_current();
+
+    if (--cs_left[id])
+        TRANSITION_TO_MT(task_critical);
+
+    if (use_mutex)
+        mutex_unlock(&mutex);
+    else
+        rwlock_unlock(&rwlock);
+    iteration[id]++;
+    TRANSITION_TO_MT(task_outside);
+}
+
+void task_outside()
+{
+    requested[get_current()] = curctx->time + 1;
+    TRANSITION_TO_MT(task_lock);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,124 @@
+/** @file sched_edf.c
+ *  @brief Benchmark: deadline misses of periodic threads
+ *
+ *  Three periodic threads and one background thread share the processor.
+ *  Every task busy-waits TASK_US microseconds of the host clock (the
+ *  default thread_clock), and a job is a fixed number of tasks:
+ *
+ *    thread   period   deadline  tasks/job
+ *    sample   1 ms     0.3 ms    2
+ *    process  5 ms     5 ms      20
+ *    log      20 ms    10 ms     50
+ *    bulk     -        -         1, always ready
+ *
+ *  After RUN_US microseconds, one line per thread is printed:
+ *
+ *      sched policy=P thread=T jobs=J misses=M
+ *
+ *  Build the runtime with LIBCHAIN_SCHED_EDF=1 for earliest deadline first
+ *  (make clean; make LIBCHAIN_SCHED_EDF=1 bench), without it the same
+ *  threads are scheduled round robin.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+
+#define TASK_US     50
+#define RUN_US      2000000
+
+#if defined(LIBCHAIN_SCHED_PRIO)
+#define POLICY "prio"
+#elif defined(LIBCHAIN_SCHED_EDF)
+#define POLICY "edf"
+#else
+#define POLICY "rr"
+#endif
+
+TASK(1, task_init)
+TASK(2, task_sample)
+TASK(3, task_process)
+TASK(4, task_log)
+TASK(5, task_bulk)
+
+static const char * const names[MAX_NUM_THREADS] =
+    { "bulk", "sample", "process", "log" };
+static const unsigned job_tasks[MAX_NUM_THREADS] = { 1, 2, 20, 50 };
+
+static unsigned long jobs[MAX_NUM_THREADS];
+static unsigned tasks_done[MAX_NUM_THREADS];
+static sched_time_t start;
+
+void init() {}
+
+static void report()
+{
+    for (unsigned id = 0; id < MAX_NUM_THREADS; ++id)
+        printf("sched policy=%s thread=%s jobs=%lu misses=%u\n",
+               POLICY, names[id], jobs[id], thread_misses(id));
+    exit(0);
+}
+
+/** @brief Do one task worth of work
+ *  @return Non-zero if that was the last task of the job
+ */
+static int work()
+{
+    unsigned id = get_current();
+    sched_time_t begin = thread_clock();
+
+    if (begin - start >= RUN_US)
+        report();
+
+    while (thread_clock() - begin < TASK_US)
+        ;
+
+    if (++tasks_done[id] < job_tasks[id])
+        return 0;
+
+    tasks_done[id] = 0;
+    jobs[id]++;
+    return 1;
+}
+
+void task_init()
+{
+    start = thread_clock();
+
+    thread_init();
+    THREAD_CREATE_PERIODIC(task_sample, 1000, 300);
+    THREAD_CREATE_PERIODIC(task_process, 5000, 5000);
+    THREAD_CREATE_PERIODIC(task_log, 20000, 10000);
+    TRANSITION_TO_MT(task_bulk);
+}
+
+void task_sample()
+{
+    if (work())
+        THREAD_WAIT_PERIOD(task_sample);
+    TRANSITION_TO_MT(task_sample);
+}
+
+void task_process()
+{
+    if (work())
+        THREAD_WAIT_PERIOD(task_process);
+    TRANSITION_TO_MT(task_process);
+}
+
+void task_log()
+{
+    if (work())
+        THREAD_WAIT_PERIOD(task_log);
+    TRANSITION_TO_MT(task_log);
+}
+
+void task_bulk()
+{
+    work();
+    TRANSITION_TO_MT(task_bulk);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
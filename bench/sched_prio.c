@@ -0,0 +1,169 @@
+/** @file sched_prio.c
+ *  @brief Benchmark: response time per priority under a mixed workload
+ *
+ *  Four threads share the processor:
+ *    radio   priority 3, sporadic: blocks after every job and is woken
+ *            by the other threads at pseudo-random times (an "interrupt")
+ *    sensor  priority 1, always ready
+ *    bulk    priority 0, two threads, always ready
+ *
+ *  The response time of a job is the number of task boundaries (of any
+ *  thread) between the moment the thread became ready and the moment its
+ *  task started. After JOBS boundaries, one line per thread is printed:
+ *
+ *      sched policy=P thread=T prio=N jobs=J p50=X p90=X p99=X max=X
+ *
+ *  Build the runtime with LIBCHAIN_SCHED_PRIO=1 for the priority scheduler
+ *  (make clean; make LIBCHAIN_SCHED_PRIO=1 bench), without it all threads
+ *  are scheduled round robin and the priorities are ignored.
+ *  SCHED_WAKE_EVERY sets the mean number of boundaries between radio
+ *  wake-ups (default 16).
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+
+#define JOBS        1000000UL
+#define HIST_SIZE   1024    // response times of HIST_SIZE and up share a bucket
+
+#define RADIO       1       // thread slots, in order of creation
+#define SENSOR      2
+
+#if defined(LIBCHAIN_SCHED_PRIO)
+#define POLICY "prio"
+#elif defined(LIBCHAIN_SCHED_EDF)
+#define POLICY "edf"
+#else
+#define POLICY "rr"
+#endif
+
+TASK(1, task_init)
+TASK(2, task_radio)
+TASK(3, task_sensor)
+TASK(4, task_bulk)
+
+static const char * const names[MAX_NUM_THREADS] =
+    { "bulk", "radio", "sensor", "bulk" };
+static const unsigned prios[MAX_NUM_THREADS] = { 0, 3, 1, 0 };
+
+static unsigned long hist[MAX_NUM_THREADS][HIST_SIZE];
+static unsigned long jobs[MAX_NUM_THREADS];
+static chain_time_t released[MAX_NUM_THREADS];
+static unsigned long boundaries;
+static unsigned wake_every;
+static int radio_blocked;
+static uint64_t rand_state = 88172645463325252ULL;
+
+void init()
+{
+    const char *env = getenv("SCHED_WAKE_EVERY");
+    wake_every = env ? strtoul(env, NULL, 0) : 16;
+    if (!wake_every)
+        wake_every = 1;
+}
+
+static unsigned long percentile(unsigned id, unsigned pct)
+{
+    unsigned long rank = (jobs[id] * pct + 99) / 100;
+    unsigned long seen = 0;
+
+    for (unsigned t = 0; t < HIST_SIZE; ++t) {
+        seen += hist[id][t];
+        if (seen >= rank && rank)
+            return t;
+    }
+    return HIST_SIZE;
+}
+
+static unsigned long maximum(unsigned id)
+{
+    for (unsigned t = HIST_SIZE; t > 0; --t)
+        if (hist[id][t - 1])
+            return t - 1;
+    return 0;
+}
+
+static void report()
+{
+    for (unsigned id = 0; id < MAX_NUM_THREADS; ++id) {
+        printf("sched policy=%s thread=%s prio=%u jobs=%lu "
+               "p50=%lu p90=%lu p99=%lu max=%lu%s\n",
+               POLICY, names[id], prios[id], jobs[id],
+               percentile(id, 50), percentile(id, 90), percentile(id, 99),
+               maximum(id), hist[id][HIST_SIZE - 1] ? "+" : "");
+    }
+    exit(0);
+}
+
+/** @brief Account the start of a job of the running thread */
+static void job_start()
+{
+    unsigned id = get_current();
+    chain_time_t response = curctx->time - released[id];
+
+    hist[id][response < HIST_SIZE ? response : HIST_SIZE - 1]++;
+    jobs[id]++;
+
+    if (++boundaries == JOBS)
+        report();
+}
+
+/** @brief The running thread is ready again right after this task */
+static void job_end()
+{
+    released[get_current()] = curctx->time + 1;
+}
+
+static unsigned long next_rand()
+{
+    // xorshift64
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+/** @brief Work of the always-ready threads: sometimes raise the interrupt */
+static void background_job()
+{
+    job_start();
+    if (radio_blocked && next_rand() % wake_every == 0) {
+        radio_blocked = 0;
+        released[RADIO] = curctx->time + 1;
+        thread_wake(RADIO);
+    }
+    job_end();
+}
+
+void task_init()
+{
+    thread_init();
+    THREAD_CREATE_PRIO(task_radio, prios[RADIO]);
+    THREAD_CREATE_PRIO(task_sensor, prios[SENSOR]);
+    THREAD_CREATE_PRIO(task_bulk, prios[3]);
+    TRANSITION_TO_MT(task_bulk);
+}
+
+void task_radio()
+{
+    job_start();
+    radio_blocked = 1;
+    thread_block();
+}
+
+void task_sensor()
+{
+    background_job();
+    TRANSITION_TO_MT(task_sensor);
+}
+
+void task_bulk()
+{
+    background_job();
+    TRANSITION_TO_MT(task_bulk);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
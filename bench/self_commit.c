@@ -0,0 +1,76 @@
+/** @file self_commit.c
+ *  @brief Micro-benchmark: task boundary cost with N self channel fields
+ *         written per task
+ *
+ *  One task reads and writes the first N fields of a self channel array
+ *  and transitions to itself. The time of ITERATIONS task boundaries,
+ *  the field accesses included, is printed as one line:
+ *
+ *      self_commit mode=M fields=N ns_per_boundary=X
+ *
+ *  SELF_COMMIT_FIELDS sets N (default 8, at most MAX_FIELDS). Build the
+ *  runtime with LIBCHAIN_SELF_EPOCH=1 for the epoch commit
+ *  (make clean; make LIBCHAIN_SELF_EPOCH=1 bench), without it the written
+ *  fields are swapped by the next prologue.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+
+#define ITERATIONS  10000000UL
+#define MAX_FIELDS  24
+
+#ifdef LIBCHAIN_SELF_EPOCH
+#define MODE "epoch"
+#else
+#define MODE "swap"
+#endif
+
+struct msg_self {
+    SELF_CHAN_FIELD_ARRAY(unsigned, v, MAX_FIELDS);
+};
+#define FIELD_INIT_msg_self { SELF_FIELD_ARRAY_INITIALIZER(MAX_FIELDS) }
+
+TASK(1, task_init)
+TASK(2, task_loop)
+
+SELF_CHANNEL(task_loop, msg_self);
+
+static unsigned num_fields;
+static unsigned long boundaries;
+static uint64_t start_ns;
+
+void init()
+{
+    const char *env = getenv("SELF_COMMIT_FIELDS");
+    num_fields = env ? strtoul(env, NULL, 0) : 8;
+    if (num_fields > MAX_FIELDS)
+        num_fields = MAX_FIELDS;
+}
+
+void task_init()
+{
+    start_ns = host_time_ns();
+    TRANSITION_TO(task_loop);
+}
+
+void task_loop()
+{
+    for (unsigned i = 0; i < num_fields; ++i) {
+        unsigned v = *CHAN_IN1(unsigned, v[i], SELF_IN_CH(task_loop)) + 1;
+        CHAN_OUT1(unsigned, v[i], v, SELF_OUT_CH(task_loop));
+    }
+
+    if (++boundaries == ITERATIONS) {
+        printf("self_commit mode=%s fields=%u ns_per_boundary=%.2f\n",
+               MODE, num_fields,
+               (double)(host_time_ns() - start_ns) / ITERATIONS);
+        exit(0);
+    }
+
+    TRANSITION_TO(task_loop);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
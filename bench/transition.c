@@ -0,0 +1,81 @@
+/** @file transition.c
+ *  @brief Micro-benchmark: cost of a task boundary, single- and multi-threaded
+ *
+ *  Every thread runs one empty task that transitions to itself. The time of
+ *  ITERATIONS task boundaries (task executions, not counting whatever the
+ *  runtime runs in between) is printed as one line:
+ *
+ *      transition threads=N quantum=Q ns_per_boundary=X
+ *
+ *  TRANSITION_THREADS selects the number of threads (1..MAX_NUM_THREADS);
+ *  with TRANSITION_THREADS=0 (the default) the tasks use TRANSITION_TO.
+ *  TRANSITION_QUANTUM sets the quantum of every thread (default THREAD_QUANTUM).
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+
+#define ITERATIONS 10000000UL
+
+TASK(1, task_init)
+TASK(2, task_spin)
+TASK(3, task_spin_st)
+
+static unsigned num_threads;
+static unsigned quantum;
+static unsigned long boundaries;
+static uint64_t start_ns;
+
+void init()
+{
+    const char *env = getenv("TRANSITION_THREADS");
+    num_threads = env ? strtoul(env, NULL, 0) : 0;
+    if (num_threads > MAX_NUM_THREADS)
+        num_threads = MAX_NUM_THREADS;
+
+    env = getenv("TRANSITION_QUANTUM");
+    quantum = env ? strtoul(env, NULL, 0) : 0;
+}
+
+static void count_boundary()
+{
+    if (++boundaries < ITERATIONS)
+        return;
+
+    printf("transition threads=%u quantum=%u ns_per_boundary=%.2f\n",
+           num_threads, quantum ? quantum : THREAD_QUANTUM,
+           (double)(host_time_ns() - start_ns) / ITERATIONS);
+    exit(0);
+}
+
+void task_init()
+{
+    start_ns = host_time_ns();
+
+    if (!num_threads)
+        TRANSITION_TO(task_spin_st);
+
+    thread_init();
+    for (unsigned i = 1; i < num_threads; ++i)
+        THREAD_CREATE(task_spin);
+    for (unsigned i = 0; i < num_threads; ++i)
+        thread_set_quantum(i, quantum);
+    TRANSITION_TO_MT(task_spin);
+}
+
+void task_spin()
+{
+    count_boundary();
+    TRANSITION_TO_MT(task_spin);
+}
+
+void task_spin_st()
+{
+    count_boundary();
+    TRANSITION_TO(task_spin_st);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
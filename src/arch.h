@@ -0,0 +1,81 @@
+/** @file arch.h
+ *  @brief Target-specific primitives used by the runtime
+ *
+ *  On the MSP430 a transition resets the stack pointer and branches into the
+ *  next task, and the buffer flip of a self-channel field is one SWPB. The
+ *  host build (LIBCHAIN_HOST) implements the same operations in C.
+ */
+
+#ifndef LIBCHAIN_ARCH_H
+#define LIBCHAIN_ARCH_H
+
+#ifdef LIBCHAIN_HOST
+
+#include "host.h"
+
+/** @brief First thing in main: returns on first boot and on every reboot */
+#define ARCH_BOOT() \
+    do { \
+        host_init(); \
+        if (setjmp(host_env) == HOST_JMP_TASK) \
+            host_enter_task(); \
+    } while (0)
+
+/** @brief Swap the bytes of the self-field index pair
+ *  @details Emulated power failures only happen at injection points, so the
+ *           plain C statement is as atomic as SWPB.
+ */
+#define ARCH_SWAP_IDX_PAIR(word) \
+    ((word) = (((word) & 0x00ffU) << 8) | (((word) >> 8) & 0x00ffU))
+
+/** @brief Reset the stack and branch to the task function */
+#define ARCH_JUMP_TO_TASK(func) host_run_task(func)
+
+/** @brief Branch to the task function from main */
+#define ARCH_BOOT_TASK(func) host_run_task(func)
+
+/** @brief Power failure injection point */
+#define ARCH_POINT(point) host_point(point)
+
+/** @brief Nothing can ever run again because of an error: end the run */
+#define ARCH_HALT(cause) host_halt(cause)
+
+/** @brief Nothing is left to run: end the run */
+#define ARCH_END() host_end()
+
+#else // !LIBCHAIN_HOST
+
+#define ARCH_BOOT()
+
+#define ARCH_SWAP_IDX_PAIR(word) \
+    __asm__ volatile ( \
+        "SWPB %[idx_pair]\n" \
+        : [idx_pair] "+m" (word) \
+    )
+
+// TODO: re-use the top-of-stack address used in entry point, instead
+//       of hardcoding the address.
+#define ARCH_JUMP_TO_TASK(func) \
+    __asm__ volatile ( /* volatile because output operands unused by C */ \
+        "mov #0x2400, r1\n" \
+        "br %[ntask]\n" \
+        : \
+        : [ntask] "r" (func) \
+    )
+
+#define ARCH_BOOT_TASK(func) \
+    __asm__ volatile ( /* volatile because output operands unused by C */ \
+        "br %[nt]\n" \
+        : /* no outputs */ \
+        : [nt] "r" (func) \
+    )
+
+#define ARCH_POINT(point)
+
+#define ARCH_HALT(cause) while (1)
+
+#define ARCH_END() while (1)
+
+#endif // !LIBCHAIN_HOST
+
+#endif // LIBCHAIN_ARCH_H
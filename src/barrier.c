@@ -0,0 +1,47 @@
+/** @file Implementation of intermittant thread barriers
+ */
+#include <stddef.h>
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define LIBCHAIN_PRINTF(...)
+#else
+#include <stdio.h>
+#define LIBCHAIN_PRINTF printf
+#endif
+
+
+#include "barrier.h"
+#include "thread.h"
+
+int barrier_init(barrier_t *b, unsigned parties) {
+    if (b == NULL || parties == 0) { return -1;}
+    task_nv_write(&b->parties, parties);
+    task_nv_write(&b->arrived, 0);
+    task_nv_write(&b->waiters, 0);
+    task_nv_write(&b->released, 0);
+    return 0;
+}
+
+void barrier_wait(barrier_t *b) {
+    thread_mask_t self = THREAD_MASK(get_current());
+
+    if (b->released & self) {
+        task_nv_write(&b->released, b->released & ~self);
+        return;
+    }
+
+    if (b->arrived + 1 < b->parties) {
+        // The arrival is counted after the rollback, so that it is kept
+        task_rollback();
+        LIBCHAIN_PRINTF("Barrier: %u arrived \r\n", b->arrived + 1);
+        task_nv_write(&b->arrived, b->arrived + 1);
+        thread_suspend_on(&b->waiters);
+    }
+
+    LIBCHAIN_PRINTF("Barrier: last arrival, releasing %x \r\n", b->waiters);
+    thread_mask_t waiters = b->waiters;
+    task_nv_write(&b->arrived, 0);
+    task_nv_write(&b->waiters, 0);
+    task_nv_write(&b->released, b->released | waiters);
+    thread_wake_set(waiters);
+}
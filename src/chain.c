@@ -10,23 +10,449 @@
 
 #include "chain.h"
 #include "thread.h"
+#include "arch.h"
+
+#ifdef LIBCHAIN_STATS
+#include "stats.h"
+#endif
 
 
 __nv chain_time_t volatile curtime = 0;
 
-/* To update the context, fill-in the unused one and flip the pointer to it */
-__nv context_t context_1 = {0};
-__nv context_t context_0 = {
-    .task = TASK_REF(_entry_task),
-    .time = 0,
-    .next_ctx = &context_1,
+/* Every thread slot has a pair of contexts. To update the context, fill-in
+ * the unused one and flip the pointer to it. The first task starts in slot
+ * 0, the only one used single-threaded; the pairs of the other slots are
+ * set up by thread_context_init. */
+__nv context_t thread_contexts[MAX_NUM_THREADS][2] = {
+    [0] = {
+        {
+            .task = TASK_REF(_entry_task),
+            .time = CHAIN_TIME_NEVER + 1,
+            .thread = 0,
+            .next_ctx = &thread_contexts[0][1],
+        },
+        {
+            .thread = 0,
+            .next_ctx = &thread_contexts[0][0],
+        },
+    },
 };
 
-__nv context_t * volatile curctx = &context_0;
+__nv context_t * volatile curctx = &thread_contexts[0][0];
+
+/* Context in which each switched-out thread continues */
+__nv context_t * volatile thread_resume_ctx[MAX_NUM_THREADS];
+
+/* Latest-writer index, see chan_var_indexed */
+__nv var_meta_t * volatile chan_latest[CHAN_LATEST_SLOTS];
+
+/* Old values of the words written by task_nv_write in one task execution */
+typedef struct {
+    volatile unsigned *word;
+    unsigned old;
+} undo_entry_t;
+
+typedef struct {
+    chain_time_t time; // execution that the entries belong to
+    unsigned count;
+    undo_entry_t entries[UNDO_LOG_SIZE];
+} undo_log_t;
+
+__nv undo_log_t undo_log = {0};
+
+/* Table of the time regions, see TIME_REGION */
+extern const time_region_t __start_chain_time_regions[] __attribute__((weak));
+extern const time_region_t __stop_chain_time_regions[] __attribute__((weak));
+
+// Transitions that one pass of the sweep may take: between two visits of a
+// time, the edge moves by up to two passes, and both the fresh times (the
+// window) and the old ones (the horizon) must stay within half the range
+#define TIME_SWEEP_MAX_PASS ((CHAIN_TIME_HALF - 1U - \
+        (CHAIN_TIME_WINDOW > CHAIN_TIME_HORIZON ? \
+         CHAIN_TIME_WINDOW : CHAIN_TIME_HORIZON)) / 2)
+
+_Static_assert(CHAIN_TIME_WINDOW < CHAIN_TIME_HALF - 2U &&
+               CHAIN_TIME_HORIZON < CHAIN_TIME_HALF - 2U &&
+               TIME_SWEEP_MAX_PASS >= 1,
+               "CHAIN_TIME_WINDOW or CHAIN_TIME_HORIZON too large");
+
+/* Edge of the current pass of the sweep, and where the sweep is: the time
+ * region, and the word of its written mask */
+__nv volatile chain_time_t chain_time_edge =
+    (CHAIN_TIME_NEVER + 1U - CHAIN_TIME_WINDOW) & CHAIN_TIME_MASK;
+__nv volatile unsigned time_sweep_region = 0;
+__nv volatile unsigned time_sweep_word = 0;
+
+// Words swept on every transition, set on the first one after a boot
+static unsigned time_sweep_step = 0;
+
+/* Global channels written by the running task execution, swapped by the
+ * prologue of the next task, whichever task that is (see self_field_dirty
+ * and self_field_stage) */
+__nv self_chan_dirty_t * volatile dirty_global_chans = NULL;
 
 // for internal instrumentation purposes
 __nv volatile unsigned _numBoots = 0;
 
+void task_nv_write(volatile unsigned *word, unsigned value)
+{
+    unsigned i;
+
+    // The log of an execution that transitioned is committed, drop it.
+    // Clear the count first: a stale count must not survive a reboot.
+    if (undo_log.time != chain_time_stamp()) {
+        undo_log.count = 0;
+        undo_log.time = chain_time_stamp();
+    }
+
+    i = undo_log.count;
+    if (i == UNDO_LOG_SIZE) {
+        LIBCHAIN_PRINTF("undo log full in task %s\r\n", curctx->task->name);
+        ARCH_HALT("undo log full");
+    }
+
+    undo_log.entries[i].word = word;
+    undo_log.entries[i].old = *word;
+    undo_log.count = i + 1;
+
+    ARCH_POINT(HOST_POINT_NV_WRITE);
+    *word = value;
+}
+
+unsigned task_nv_initial(volatile unsigned *word)
+{
+    unsigned i;
+
+    if (undo_log.time != chain_time_stamp())
+        return *word;
+
+    // The first entry of the word holds its value before the execution
+    for (i = 0; i < undo_log.count; ++i) {
+        if (undo_log.entries[i].word == word)
+            return undo_log.entries[i].old;
+    }
+    return *word;
+}
+
+void timestamp_track(chain_time_t *timestamp)
+{
+    const time_region_t *region;
+
+    for (region = __start_chain_time_regions;
+         region < __stop_chain_time_regions; ++region) {
+        uintptr_t offset = (uint8_t *)timestamp - region->start;
+
+        if (offset < region->size) {
+            unsigned bit = offset / _Alignof(chain_time_t);
+
+            // Repeated if restarted before the time was set
+            region->written[bit / TIME_REGION_BITS] |=
+                1U << (bit % TIME_REGION_BITS);
+            return;
+        }
+    }
+
+    LIBCHAIN_PRINTF("time in no time region in task %s\r\n",
+                    curctx->task->name);
+}
+
+/** @brief Number of words to sweep on every transition, for a pass to take
+ *         at most TIME_SWEEP_MAX_PASS transitions */
+static unsigned time_sweep_step_size()
+{
+    const time_region_t *region;
+    unsigned words = 1; // the start of the pass
+    unsigned step;
+
+    for (region = __start_chain_time_regions;
+         region < __stop_chain_time_regions; ++region)
+        words += TIME_REGION_WORDS(region->size);
+
+    step = (words + TIME_SWEEP_MAX_PASS - 1) / TIME_SWEEP_MAX_PASS;
+    return step < TIME_REBASE_STEP ? TIME_REBASE_STEP : step;
+}
+
+/** @brief Store a time as it compares in the current pass */
+static void time_rebase(volatile chain_time_t *timestamp)
+{
+    chain_time_t t = *timestamp;
+    chain_time_t rebased;
+
+    if (t == CHAIN_TIME_NEVER)
+        return;
+
+    rebased = chain_time_effective(t);
+    if (rebased != t)
+        *timestamp = rebased;
+}
+
+/** @brief Sweep the next few words of the written masks of the time regions,
+ *         rebasing the times that they mark
+ *  @details A step can be cut short or repeated by a reboot: rebasing a time
+ *           does not change how it compares, so either way is harmless.
+ */
+static void time_rebase_step()
+{
+    unsigned step;
+
+    if (!time_sweep_step)
+        time_sweep_step = time_sweep_step_size();
+
+    // The undo log of an execution that old is stale, see task_nv_write
+    time_rebase(&undo_log.time);
+
+    for (step = 0; step < time_sweep_step; ++step) {
+        const time_region_t *region =
+            __start_chain_time_regions + time_sweep_region;
+        unsigned word = time_sweep_word;
+        unsigned bits;
+
+        if (region >= __stop_chain_time_regions) {
+            chain_time_edge =
+                (chain_time_stamp() - CHAIN_TIME_WINDOW) & CHAIN_TIME_MASK;
+            time_sweep_word = 0;
+            time_sweep_region = 0;
+            continue;
+        }
+
+        bits = region->written[word];
+        while (bits) {
+            unsigned idx = word * TIME_REGION_BITS + __builtin_ctz(bits);
+
+            time_rebase((chain_time_t *)(region->start +
+                                         idx * _Alignof(chain_time_t)));
+            bits &= bits - 1;
+        }
+
+        // The word first, so that a reboot cannot leave it past the end of
+        // the next region
+        if (word + 1 < TIME_REGION_WORDS(region->size)) {
+            time_sweep_word = word + 1;
+        } else {
+            time_sweep_word = 0;
+            time_sweep_region = time_sweep_region + 1;
+        }
+    }
+}
+
+/** @brief Restore the words written by the restarted task execution */
+static void undo_log_rollback()
+{
+    unsigned i;
+
+    if (undo_log.time != chain_time_stamp())
+        return;
+
+    // Restore in reverse order, so that the oldest value of a word written
+    // more than once wins, and like the dirty list, make progress
+    while ((i = undo_log.count) > 0) {
+        --i;
+        *undo_log.entries[i].word = undo_log.entries[i].old;
+        undo_log.count = i;
+    }
+}
+
+#ifndef LIBCHAIN_SELF_EPOCH
+/** @brief Unlist the self (or global) channels written by the restarted
+ *         task execution
+ *  @details Unmarks every listed field, as reads of a global field go by
+ *           its dirty bit (see chan_field_var), and like the swap in the
+ *           prologue, clears a bit of the mask strictly after that, so the
+ *           walk can be repeated after a reboot.
+ */
+static void self_chans_rollback(self_chan_dirty_t * volatile *list)
+{
+    self_chan_dirty_t *dirty;
+    unsigned w;
+
+    while ((dirty = *list) != NULL) {
+        unsigned *mask = SELF_CHAN_DIRTY_MASK(dirty);
+        uint8_t *data = (uint8_t *)dirty - dirty->data_offset;
+
+        for (w = 0; w < dirty->num_words; ++w) {
+            unsigned bits;
+
+            while ((bits = mask[w]) != 0) {
+                unsigned idx = w * SELF_CHAN_MASK_BITS + __builtin_ctz(bits);
+                self_field_meta_t *self_field =
+                    (self_field_meta_t *)(data + idx * SELF_FIELD_ALIGN);
+
+                self_field->idx_pair &= ~SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
+                mask[w] = bits & (bits - 1);
+            }
+        }
+
+        dirty->listed = 0;
+        *list = dirty->next;
+    }
+}
+#else
+/** @brief Unlist the self (or global) channels written by the restarted
+ *         task execution, with LIBCHAIN_SELF_EPOCH
+ *  @details Makes the other var the one written last again in every field
+ *           that the execution staged. Only a field whose var written last
+ *           carries the current time is flipped, so the walk can be repeated
+ *           after a reboot. A channel listed with another time was linked
+ *           by a staging cut short before it set any bit.
+ */
+static void self_chans_rollback(self_chan_dirty_t * volatile *list)
+{
+    chain_time_t now = chain_time_stamp();
+    self_chan_dirty_t *dirty;
+    unsigned w;
+
+    while ((dirty = *list) != NULL) {
+        unsigned *mask = SELF_CHAN_DIRTY_MASK(dirty);
+        uint8_t *data = (uint8_t *)dirty - dirty->data_offset;
+
+        for (w = 0; dirty->time == now && w < dirty->num_words; ++w) {
+            unsigned bits = mask[w];
+
+            while (bits) {
+                unsigned idx = w * SELF_CHAN_MASK_BITS + __builtin_ctz(bits);
+                self_field_meta_t *self_field =
+                    (self_field_meta_t *)(data + idx * SELF_FIELD_ALIGN);
+                unsigned idx_pair = self_field->idx_pair;
+                var_meta_t *last = (var_meta_t *)((uint8_t *)self_field +
+                    offsetof(SELF_FIELD_TYPE(void_type_t), var) +
+                    ((idx_pair & SELF_CHAN_IDX_BIT_LAST) ?
+                        self_field->var_size : 0));
+
+                if (last->timestamp == now)
+                    self_field->idx_pair = idx_pair ^ SELF_CHAN_IDX_BIT_LAST;
+                bits &= bits - 1;
+            }
+        }
+
+        // Listed again, with a clear mask, by the next staging
+        dirty->time = CHAIN_TIME_NEVER;
+        *list = dirty->next;
+    }
+}
+#endif
+
+#ifndef LIBCHAIN_SELF_EPOCH
+void self_field_dirty(self_chan_dirty_t *dirty, unsigned *word, unsigned bit,
+                      self_field_meta_t *field)
+{
+    // Any task can write a global channel: the list is shared
+    self_chan_dirty_t * volatile *list =
+        (field->idx_pair & SELF_CHAN_IDX_BIT_GLOBAL) ?
+            &dirty_global_chans : &curctx->task->dirty_self_chans;
+
+    // Link the channel before setting the bit: a bit set in a channel that
+    // is not on the list would never be cleared
+    if (!dirty->listed) {
+        dirty->next = *list;
+        *list = dirty;
+        dirty->listed = 1;
+    }
+
+    *word |= bit;
+
+    field->idx_pair &= ~(SELF_CHAN_IDX_BIT_DIRTY_NEXT);
+    field->idx_pair |= SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
+}
+#else
+void self_field_stage(self_chan_dirty_t *dirty, unsigned *word, unsigned bit,
+                      self_field_meta_t *field, unsigned var_size)
+{
+    chain_time_t now = chain_time_stamp();
+    self_chan_dirty_t * volatile *list =
+        (field->idx_pair & SELF_CHAN_IDX_BIT_GLOBAL) ?
+            &dirty_global_chans : &curctx->task->dirty_self_chans;
+
+    // The mask of an earlier execution is stale. Link the channel before
+    // setting its time: the rollback unlinks a channel listed with another
+    // time without walking its mask.
+    if (dirty->time != now) {
+        unsigned *mask = SELF_CHAN_DIRTY_MASK(dirty);
+        unsigned w;
+
+        for (w = 0; w < dirty->num_words; ++w)
+            mask[w] = 0;
+        dirty->next = *list;
+        *list = dirty;
+
+        // The sweep rebases it, so that it cannot come around to a later
+        // time of the task
+        if (dirty->time == CHAIN_TIME_NEVER)
+            timestamp_track((chain_time_t *)&dirty->time);
+        dirty->time = now;
+    }
+
+    if (!field->var_size)
+        field->var_size = var_size;
+    *word |= bit;
+
+    // Last: the flip stages the var, and the next transition commits it
+    field->idx_pair ^= SELF_CHAN_IDX_BIT_LAST;
+}
+#endif
+
+/** @brief Swap the dirty fields of the self channels of a task, or of the
+ *         global channels
+ *  @details Walks the mask of every listed channel with bit scans, so the
+ *           cost is in the number of written fields, plus a load per mask
+ *           word.
+ *
+ *           It is safe to repeat the walk for the same field, because the
+ *           swap operation clears the dirty bit. We only need to be a little
+ *           bit careful to clear the bit in the mask strictly after the swap.
+ *           Trade-off: either we do one FRAM write after each field, or we
+ *           clear the mask at the end but also not make forward progress if
+ *           we reboot in the middle of this loop. We opt for making progress.
+ */
+#ifndef LIBCHAIN_SELF_EPOCH
+static void self_chans_commit(self_chan_dirty_t * volatile *list)
+{
+    self_chan_dirty_t *dirty;
+    unsigned w;
+
+    while ((dirty = *list) != NULL) {
+        unsigned *mask = SELF_CHAN_DIRTY_MASK(dirty);
+        uint8_t *data = (uint8_t *)dirty - dirty->data_offset;
+
+        for (w = 0; w < dirty->num_words; ++w) {
+            unsigned bits;
+
+            while ((bits = mask[w]) != 0) {
+                unsigned idx = w * SELF_CHAN_MASK_BITS + __builtin_ctz(bits);
+                self_field_meta_t *self_field =
+                    (self_field_meta_t *)(data + idx * SELF_FIELD_ALIGN);
+
+                if (self_field->idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT) {
+                    // Atomically: swap AND clear the dirty bit (by "moving" it over to MSB)
+                    ARCH_SWAP_IDX_PAIR(self_field->idx_pair);
+                }
+
+                mask[w] = bits & (bits - 1);
+            }
+        }
+
+        dirty->listed = 0;
+        *list = dirty->next;
+    }
+}
+#else
+/** @brief Drop the list of the self channels of a task, or of the global
+ *         channels, with LIBCHAIN_SELF_EPOCH
+ *  @details The transition moved the time on, which committed every var
+ *           that the last execution staged: no field is touched.
+ */
+static void self_chans_commit(self_chan_dirty_t * volatile *list)
+{
+    *list = NULL;
+}
+#endif
+
+void task_rollback()
+{
+    self_chans_rollback(&curctx->task->dirty_self_chans);
+    self_chans_rollback(&dirty_global_chans);
+    undo_log_rollback();
+}
+
 /**
  * @brief Function to be invoked at the beginning of every task
  */
@@ -36,42 +462,41 @@ void task_prologue()
 
     // Swaps of the self-channel buffer happen on transitions, not restarts.
     // We detect transitions by comparing the current time with a timestamp.
-    if (curctx->time != curtask->last_execute_time) {
-
-        // Minimize FRAM reads
-        self_field_meta_t **dirty_self_fields = curtask->dirty_self_fields;
+    if (chain_time_stamp() != curtask->last_execute_time) {
+        self_chans_commit(&curtask->dirty_self_chans);
 
-        int i;
+        // Commit the global channels written by the task that transitioned,
+        // whichever task (and thread) that was
+        self_chans_commit(&dirty_global_chans);
 
-        // It is safe to repeat the loop for the same element, because the swap
-        // operation clears the dirty bit. We only need to be a little bit careful
-        // to decrement the count strictly after the swap.
-        while ((i = curtask->num_dirty_self_fields) > 0) {
-            self_field_meta_t *self_field = dirty_self_fields[--i];
+        // Once rebased, a time of a task that ran long ago cannot come
+        // around to the current time
+        if (curtask->last_execute_time == CHAIN_TIME_NEVER)
+            timestamp_track((chain_time_t *)&curtask->last_execute_time);
+        curtask->last_execute_time = chain_time_stamp();
 
-            if (self_field->idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT) {
-                // Atomically: swap AND clear the dirty bit (by "moving" it over to MSB)
-                __asm__ volatile (
-                    "SWPB %[idx_pair]\n"
-                    : [idx_pair]  "=m" (self_field->idx_pair)
-                );
-            }
-
-            // Trade-off: either we do one FRAM write after each element, or
-            // we do only one write at the end (set to 0) but also not make
-            // forward progress if we reboot in the middle of this loop.
-            // We opt for making progress.
-            curtask->num_dirty_self_fields = i;
-        }
+        time_rebase_step();
 
-        curtask->last_execute_time = curctx->time;
+#ifdef LIBCHAIN_STATS
+        stats_prologue(curtask, 0);
+#endif
+#ifdef LIBCHAIN_TRACE
+        trace_task(TRACE_TASK_START, curtask, curtask->idx);
+#endif
     } else {
         // In this case, swapping that needed to take place after the last
         // transition has run to completion (even if it was restarted) [because
         // the last_execute_time was set]. We get into this clause only
         // because of a restart. We must clear any state that the incomplete
         // execution of the task might have changed.
-        curtask->num_dirty_self_fields = 0;
+        task_rollback();
+
+#ifdef LIBCHAIN_STATS
+        stats_prologue(curtask, 1);
+#endif
+#ifdef LIBCHAIN_TRACE
+        trace_task(TRACE_TASK_RESTART, curtask, curtask->idx);
+#endif
     }
 }
 
@@ -83,6 +508,26 @@ void task_prologue()
  *  TODO: mark this function as bare (i.e. no prologue) for efficiency
  */
 void transition_to(task_t *next_task)
+{
+    transition_to_thread(next_task, curctx->thread);
+}
+
+void thread_context_init(unsigned thread, task_t *task)
+{
+    context_t *pair = thread_contexts[thread];
+
+    pair[0].task = task;
+    pair[0].time = curctx->time;
+    pair[0].thread = thread;
+    pair[0].next_ctx = &pair[1];
+
+    pair[1].thread = thread;
+    pair[1].next_ctx = &pair[0];
+
+    thread_resume_ctx[thread] = &pair[0];
+}
+
+void transition_to_thread(task_t *next_task, unsigned thread)
 {
     context_t *next_ctx; // this should be in a register for efficiency
                          // (if we really care, write this func in asm)
@@ -111,34 +556,46 @@ void transition_to(task_t *next_task)
     // to current context and a pointer to next context inside the context
     // structure. The only reason to do that is if it is more efficient --
     // i.e. avoids XORing the index and getting the actual pointer.
+    //
+    // NOTE: The pair of a context, and its thread, never change once set
+    // up, so a transition writes only the task and the time. A thread
+    // switch also saves where the current thread continues, in the unused
+    // context of its pair: until the flip, nothing reads that context nor
+    // the resume pointer of the running thread, so a reboot before the
+    // flip leaves both to be written again by the restarted task.
 
-    // TODO: handle overflow of timestamp. Some very raw ideas:
-    //          * limit the age of values
-    //          * a maintainance task that fixes up stored timestamps
-    //          * extra bit to mark timestamps as pre/post overflow
+    // NOTE: the time wraps around, see CHAIN_TIME_WINDOW.
 
     // TODO: re-use the top-of-stack address used in entry point, instead
-    //       of hardcoding the address.
+    //       of hardcoding the address (see ARCH_JUMP_TO_TASK).
     //
     //       Probably need to write a custom entry point in asm, and
     //       use it instead of the C runtime one.
     LIBCHAIN_PRINTF("transition_to \r\n");
+    ARCH_POINT(HOST_POINT_TRANSITION);
 	// Sorry, leaving dead code here...
     next_ctx = curctx->next_ctx;
+
+    if (thread != curctx->thread) {
+        next_ctx->task = next_task;
+        next_ctx->time = curctx->time;
+        thread_resume_ctx[curctx->thread] = next_ctx;
+
+        next_task = thread_resume_ctx[thread]->task;
+        next_ctx = thread_resume_ctx[thread]->next_ctx;
+    }
+
     next_ctx->task = next_task;
+    // Skip the times stored as CHAIN_TIME_NEVER
     next_ctx->time = curctx->time + 1;
+    if (!(next_ctx->time & CHAIN_TIME_MASK))
+        next_ctx->time = next_ctx->time + 1;
 
-    next_ctx->next_ctx = curctx;
     curctx = next_ctx;
 
     task_prologue();
 
-    __asm__ volatile ( // volatile because output operands unused by C
-        "mov #0x2400, r1\n"
-        "br %[ntask]\n"
-        :
-        : [ntask] "r" (next_task->func)
-    );
+    ARCH_JUMP_TO_TASK(next_task->func);
 
     // Alternative:
     // task-function prologue:
@@ -149,7 +606,29 @@ void transition_to(task_t *next_task)
     //     br next_task
 }
 
+void *mc_access(chan_meta_t *meta, const mc_meta_t *mc, int out)
+{
+    task_t *task = curctx->task;
+    unsigned i;
+
+    if (out) {
+        if (task == mc->src)
+            return meta;
+    } else {
+        for (i = 0; i < mc->num_dests; ++i)
+            if (task == mc->dests[i])
+                return meta;
+    }
+
+    LIBCHAIN_PRINTF("task %s is not the %s of multicast channel %s\r\n",
+                    task->name, out ? "source" : "destination",
+                    meta->diag.dest_name);
+    ARCH_HALT("task is not an endpoint of the multicast channel");
+    return meta;
+}
+
 /** @brief Sync: return the most recently updated value of a given field
+ *  @details Generic path, used by CHAN_IN only with diagnostics enabled.
  *  @param field_name   string name of the field, used for diagnostics
  *  @param var_size     size of the 'variable' type (var_meta_t + value type)
  *  @param count        number of channels to sync
@@ -160,7 +639,7 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
 {
     va_list ap;
     unsigned i;
-    unsigned latest_update = 0;
+    chain_time_t latest_update = CHAIN_TIME_NEVER;
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
     //nsigned latest_chan_idx = 0;
     //char curidx;
@@ -168,9 +647,10 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
 
     var_meta_t *var;
     var_meta_t *latest_var = NULL;
-    //May be able to omit this code... as long as CH_TH's are used, it'll work out
-    //thread_t * curthread = get_current_thread();
-    //unsigned curthid = curthread->thread_id;
+#ifdef LIBCHAIN_TRACE
+    uint8_t *latest_chan = NULL;
+    size_t latest_offset = 0;
+#endif
     //LIBCHAIN_PRINTF("[%u] %s: in: '%s':", curctx->time,
     //                curctx->task->name, field_name);
 
@@ -178,7 +658,7 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
 
     for (i = 0; i < count; ++i) {
         uint8_t *chan = va_arg(ap, uint8_t *);
-        size_t field_offset = va_arg(ap, unsigned);
+        size_t field_offset = va_arg(ap, size_t);
 
         uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
         chan_meta_t *chan_meta = (chan_meta_t *)(chan +
@@ -186,20 +666,15 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
         uint8_t *field = chan_data + field_offset;
 
         switch (chan_meta->type) {
-            case CHAN_TYPE_SELF: {
-                self_field_meta_t *self_field = (self_field_meta_t *)field;
-
-                unsigned var_offset =
-                    (self_field->idx_pair & SELF_CHAN_IDX_BIT_CURRENT) ? var_size : 0;
-
-                var = (var_meta_t *)(field +
-                        offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
-
+            case CHAN_TYPE_SELF:
+            case CHAN_TYPE_SCHEDULER:
+            case CHAN_TYPE_GLOBAL:
+                var = chan_field_var(field, var_size, 1,
+                                     SELF_CHAN_IDX_BIT_CURRENT);
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
                 //curidx = '0' + self_field->curidx;
 #endif
                 break;
-            }
             default:
                 var = (var_meta_t *)(field +
                         offsetof(FIELD_TYPE(void_type_t), var));
@@ -216,9 +691,15 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
                (uint16_t)var, var->timestamp);
                */
 
-        if (var->timestamp > latest_update) {
+        // The first var stands in until one is newer, so that a field that
+        // was never written reads as its initial value, as without diagnostics
+        if (!latest_var || chain_time_after(var->timestamp, latest_update)) {
             latest_update = var->timestamp;
             latest_var = var;
+#ifdef LIBCHAIN_TRACE
+            latest_chan = chan;
+            latest_offset = field_offset;
+#endif
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
             //latest_chan_idx = i;
 #endif
@@ -226,6 +707,10 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
     }
     va_end(ap);
 
+#ifdef LIBCHAIN_TRACE
+    trace_field(TRACE_CHAN_IN, latest_chan, latest_offset);
+#endif
+
     //LIBCHAIN_PRINTF(": {latest %u}: ", latest_chan_idx);
 
     uint8_t *value = (uint8_t *)latest_var + offsetof(VAR_TYPE(void_type_t), value);
@@ -248,11 +733,13 @@ void *chan_in(const char *field_name, size_t var_size, int count, ...)
 }
 
 /** @brief Write a value to a field in a channel
+ *  @details Generic path, used by CHAN_OUT only with diagnostics enabled.
  *  @param field_name    string name of the field, used for diagnostics
  *  @param value         pointer to value data
  *  @param var_size      size of the 'variable' type (var_meta_t + value type)
  *  @param count         number of output channels
- *  @param ...           channel ptr, field offset in corresponding message type
+ *  @param ...           channel ptr, field offset in corresponding message type,
+ *                       dirty header of the channel if it is a self channel
  */
 void chan_out(const char *field_name, const void *value,
               size_t var_size, int count, ...)
@@ -268,7 +755,8 @@ void chan_out(const char *field_name, const void *value,
 
     for (i = 0; i < count; ++i) {
         uint8_t *chan = va_arg(ap, uint8_t *);
-        size_t field_offset = va_arg(ap, unsigned);
+        size_t field_offset = va_arg(ap, size_t);
+        self_chan_dirty_t *dirty = va_arg(ap, self_chan_dirty_t *);
 
         uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
         chan_meta_t *chan_meta = (chan_meta_t *)(chan +
@@ -276,39 +764,24 @@ void chan_out(const char *field_name, const void *value,
         uint8_t *field = chan_data + field_offset;
 
         switch (chan_meta->type) {
-            case CHAN_TYPE_SELF: {
-                self_field_meta_t *self_field = (self_field_meta_t *)field;
-                task_t *curtask = curctx->task;
+            case CHAN_TYPE_SELF:
+            case CHAN_TYPE_SCHEDULER:
+            case CHAN_TYPE_GLOBAL:
+                var = chan_field_var(field, var_size, 1, SELF_CHAN_IDX_BIT_NEXT);
+                chan_var_stamp(var);
 
-                unsigned var_offset =
-                    (self_field->idx_pair & SELF_CHAN_IDX_BIT_NEXT) ? var_size : 0;
-
-                var = (var_meta_t *)(field +
-                        offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
-
-                // "Enqueue" the buffer index to be flipped on next transition:
-                //   (1) initialize the dirty bit for next swap, or, in other words,
-                //       "finalize" clearing of the dirty bit from the previous
-                //       swap, since the swap "clears" the dirty bit by moving
-                //       it over from LSB to MSB.
-                //   (2) mark the index dirty, which enques the swap
-                //   (3) add the field to the list of dirty fields
-                //
-                // NOTE: these do not have to be atomic, and can be repeated any
-                // number of times (idempotent). Counter of the dirty list is
-                // reset on in task prologue.
-                self_field->idx_pair &= ~(SELF_CHAN_IDX_BIT_DIRTY_NEXT);
-                self_field->idx_pair |= SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
-                curtask->dirty_self_fields[curtask->num_dirty_self_fields++] = self_field;
+                // "Enqueue" the buffer index to be flipped on next transition
+                chan_self_field_out((self_field_meta_t *)field, dirty,
+                                    field_offset, var, var_size);
 
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
                 //curidx = '0' + next_self_chan_field_idx;
 #endif
                 break;
-            }
             default:
                 var = (var_meta_t *)(field +
                         offsetof(FIELD_TYPE(void_type_t), var));
+                chan_var_stamp(var);
 #ifdef LIBCHAIN_ENABLE_DIAGNOSTICS
                 //curidx = ' ';
 #endif
@@ -328,24 +801,41 @@ void chan_out(const char *field_name, const void *value,
         */
 #endif
 
-        var->timestamp = curctx->time;
         void *var_value = (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
         memcpy(var_value, value, var_size - sizeof(var_meta_t));
+#ifdef LIBCHAIN_STATS
+        curctx->task->stats.chan_out_bytes += var_size - sizeof(var_meta_t);
+#endif
+
+        if (chan_meta->type != CHAN_TYPE_SELF &&
+            chan_meta->type != CHAN_TYPE_SCHEDULER &&
+            chan_meta->type != CHAN_TYPE_GLOBAL) {
+            size_t len = strlen(field_name);
+            chan_latest[CHAN_NAME_HASH(field_name, len)] = var;
+        }
+
+#ifdef LIBCHAIN_TRACE
+        trace_field(TRACE_CHAN_OUT, chan, field_offset);
+#endif
+
+        ARCH_POINT(HOST_POINT_CHAN_OUT);
     }
 
     va_end(ap);
 }
 
-// Defined in thread.c
-extern unsigned curr_free_index;
-
 /** @brief Entry point upon reboot */
 int main() {
 
+    ARCH_BOOT();
+
     _init();
     _numBoots++;
 
-    curr_free_index = 0;
+#ifdef LIBCHAIN_TRACE
+    trace_boot(_numBoots);
+#endif
+
     // Resume execution at the last task that started but did not finish
 
     // TODO: using the raw transtion would be possible once the
@@ -356,11 +846,7 @@ int main() {
     task_prologue();
     //LIBCHAIN_PRINTF("Finished prologue checking task |  %x | \r\n", curctx->task->func);
 
-    __asm__ volatile ( // volatile because output operands unused by C
-        "br %[nt]\n"
-        : /* no outputs */
-        : [nt] "r" (curctx->task->func)
-    );
+    ARCH_BOOT_TASK(curctx->task->func);
 
     return 0; // TODO: write our own entry point and get rid of this
 }
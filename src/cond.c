@@ -0,0 +1,54 @@
+/** @file Implementation of intermittant condition variables
+ */
+#include <stddef.h>
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define LIBCHAIN_PRINTF(...)
+#else
+#include <stdio.h>
+#define LIBCHAIN_PRINTF printf
+#endif
+
+
+#include "cond.h"
+#include "thread.h"
+
+int cond_init(cond_t *c) {
+    if (c == NULL) { return -1;}
+    task_nv_write(&c->waiters, 0);
+    return 0;
+}
+
+void cond_wait(cond_t *c, mutex_t *m) {
+    task_rollback();
+
+    // Without what this execution did, the mutex is still held only if it
+    // was locked by an earlier task, or handed over to this thread.
+    if (!m->free && m->holder == get_current())
+        mutex_unlock(m);
+
+    LIBCHAIN_PRINTF("Waiting on condition \r\n");
+    thread_suspend_on(&c->waiters);
+}
+
+void cond_signal(cond_t *c) {
+    thread_mask_t waiters = c->waiters;
+
+    if (!waiters)
+        return;
+
+    unsigned next = thread_mask_next(waiters, get_current());
+    LIBCHAIN_PRINTF("Signal %u \r\n", next);
+    task_nv_write(&c->waiters, waiters & ~THREAD_MASK(next));
+    thread_wake(next);
+}
+
+void cond_broadcast(cond_t *c) {
+    thread_mask_t waiters = c->waiters;
+
+    if (!waiters)
+        return;
+
+    task_nv_write(&c->waiters, 0);
+    thread_wake_set(waiters);
+}
@@ -0,0 +1,270 @@
+/** @file host.c
+ *  @brief Host (x86-64 Linux) port: emulated FRAM and power failures
+ *
+ *  All __nv variables live in the .nv_vars section, which the host linker
+ *  script (bld/host/nv.ld) page-aligns and brackets with __nv_start and
+ *  __nv_end. If CHAIN_NV_FILE is set, that range is replaced by a shared
+ *  mapping of the file, so state survives the process, not only emulated
+ *  reboots. The file is (re)initialized from the pristine image whenever its
+ *  header does not match the image of the running binary.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chain.h"
+#include "host.h"
+
+#define NV_MAGIC 0x4e56434eUL // "NCVN"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t image_hash; // hash of the pristine image, with this field zeroed
+} nv_header_t;
+
+// Must be the first thing in the NV range (see nv.ld)
+__attribute__((section(".nv_header"), used))
+static nv_header_t nv_header = { NV_MAGIC, 0, 0 };
+
+extern uint8_t __nv_start[];
+extern uint8_t __nv_end[];
+
+host_config_t host_config;
+host_stats_t host_stats;
+jmp_buf host_env;
+
+static void (*pending_task)(void);
+static unsigned running_task_idx;
+static uint64_t running_task_start_ns;
+static uint64_t rand_state;
+static int initialized;
+static uint8_t *nv_snapshot;
+
+uint64_t host_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long env_ulong(const char *name, unsigned long dflt)
+{
+    const char *val = getenv(name);
+    return val ? strtoul(val, NULL, 0) : dflt;
+}
+
+static uint64_t image_hash(const uint8_t *start, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= start[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void map_nv_file(const char *path)
+{
+    size_t size = __nv_end - __nv_start;
+    nv_header_t file_header;
+    int fd;
+
+    nv_header.size = size;
+    nv_header.image_hash = 0;
+    nv_header.image_hash = image_hash(__nv_start, size);
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror(path);
+        exit(1);
+    }
+
+    if (pread(fd, &file_header, sizeof(file_header), 0) != sizeof(file_header) ||
+        memcmp(&file_header, &nv_header, sizeof(nv_header)) != 0) {
+        // Fresh or stale file: start from the pristine image
+        if (ftruncate(fd, size) != 0 ||
+            pwrite(fd, __nv_start, size, 0) != (ssize_t)size) {
+            perror(path);
+            exit(1);
+        }
+    }
+
+    if (mmap(__nv_start, size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+}
+
+static void report_at_exit(void)
+{
+    host_report(stderr);
+}
+
+void host_init()
+{
+    const char *nv_file;
+
+    if (initialized)
+        return;
+    initialized = 1;
+
+    host_config.reset_every = env_ulong("CHAIN_RESET_EVERY", 0);
+    host_config.reset_random = env_ulong("CHAIN_RESET_RANDOM", 0);
+    host_config.reset_at_chan_out = env_ulong("CHAIN_RESET_AT_CHAN_OUT", 0);
+    host_config.max_transitions = env_ulong("CHAIN_MAX_TRANSITIONS", 0);
+    host_config.seed = env_ulong("CHAIN_RESET_SEED", 1);
+    rand_state = host_config.seed ? host_config.seed : 1;
+
+    nv_file = getenv("CHAIN_NV_FILE");
+    if (nv_file && *nv_file)
+        map_nv_file(nv_file);
+
+    if (getenv("CHAIN_REPORT") || host_config.max_transitions)
+        atexit(report_at_exit);
+
+    host_stats.start_ns = host_time_ns();
+    running_task_start_ns = host_stats.start_ns;
+}
+
+static void account_task_time(uint64_t now)
+{
+    host_stats.task_ns[running_task_idx] += now - running_task_start_ns;
+    running_task_start_ns = now;
+}
+
+void host_run_task(void (*func)(void))
+{
+    pending_task = func;
+    longjmp(host_env, HOST_JMP_TASK);
+}
+
+void host_enter_task()
+{
+    account_task_time(host_time_ns());
+    running_task_idx = curctx->task->idx % 32;
+    host_stats.task_runs[running_task_idx]++;
+
+    pending_task();
+
+    fprintf(stderr, "chain: task '%s' returned without a transition\r\n",
+            curctx->task->name);
+    abort();
+}
+
+void host_reboot()
+{
+    uint64_t now = host_time_ns();
+
+    host_stats.wasted_ns += now - running_task_start_ns;
+    account_task_time(now);
+    host_stats.reboots++;
+    longjmp(host_env, HOST_JMP_REBOOT);
+}
+
+void host_halt(const char *cause)
+{
+    account_task_time(host_time_ns());
+    fprintf(stderr, "chain: halted in task %s: %s\r\n",
+            curctx->task->name, cause);
+    exit(1);
+}
+
+void host_end()
+{
+    account_task_time(host_time_ns());
+    fprintf(stderr, "chain: all threads ended\r\n");
+    exit(0);
+}
+
+static unsigned long next_rand()
+{
+    // xorshift64
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 7;
+    rand_state ^= rand_state << 17;
+    return rand_state;
+}
+
+void host_point(host_point_t point)
+{
+    switch (point) {
+        case HOST_POINT_TRANSITION:
+            host_stats.transitions++;
+            if (host_config.max_transitions &&
+                host_stats.transitions > host_config.max_transitions) {
+                account_task_time(host_time_ns());
+                exit(0);
+            }
+            if (host_config.reset_every &&
+                host_stats.transitions % host_config.reset_every == 0)
+                host_reboot();
+            break;
+        case HOST_POINT_CHAN_OUT:
+            host_stats.chan_outs++;
+            if (host_config.reset_at_chan_out &&
+                host_stats.chan_outs == host_config.reset_at_chan_out)
+                host_reboot();
+            break;
+        case HOST_POINT_NV_WRITE:
+            host_stats.nv_writes++;
+            break;
+        case HOST_POINT_BLOCK:
+            break;
+    }
+
+    if (host_config.reset_random &&
+        next_rand() % host_config.reset_random == 0)
+        host_reboot();
+}
+
+void host_nv_snapshot()
+{
+    size_t size = __nv_end - __nv_start;
+
+    if (!nv_snapshot)
+        nv_snapshot = malloc(size);
+    memcpy(nv_snapshot, __nv_start, size);
+}
+
+size_t host_nv_changed()
+{
+    size_t size = __nv_end - __nv_start;
+    size_t changed = 0;
+
+    for (size_t i = 0; nv_snapshot && i < size; ++i)
+        changed += nv_snapshot[i] != __nv_start[i];
+    return changed;
+}
+
+void host_report(FILE *out)
+{
+    uint64_t elapsed_ns = host_time_ns() - host_stats.start_ns;
+    double secs = elapsed_ns / 1e9;
+
+    fprintf(out, "transitions:      %lu\n", host_stats.transitions);
+    fprintf(out, "reboots:          %lu\n", host_stats.reboots);
+    fprintf(out, "chan_outs:        %lu\n", host_stats.chan_outs);
+    fprintf(out, "nv_writes:        %lu\n", host_stats.nv_writes);
+    fprintf(out, "elapsed:          %.3f s\n", secs);
+    fprintf(out, "transitions/sec:  %.0f\n",
+            secs > 0 ? host_stats.transitions / secs : 0.0);
+    fprintf(out, "re-execution:     %.3f s (%.1f%%)\n", host_stats.wasted_ns / 1e9,
+            elapsed_ns ? 100.0 * host_stats.wasted_ns / elapsed_ns : 0.0);
+    for (unsigned i = 0; i < 32; ++i) {
+        if (!host_stats.task_runs[i])
+            continue;
+        fprintf(out, "task %2u:          %lu runs, %.3f s (%.1f%%)\n", i,
+                host_stats.task_runs[i], host_stats.task_ns[i] / 1e9,
+                elapsed_ns ? 100.0 * host_stats.task_ns[i] / elapsed_ns : 0.0);
+    }
+}
@@ -0,0 +1,38 @@
+/** @file Interface for intermittant thread barriers
+ *
+ *  Barriers must be in non-volatile memory (__nv). Arrivals are counted
+ *  through the undo log, so an arrival cut off by a power failure is not
+ *  counted, and one that completed is counted exactly once.
+ */
+
+#ifndef _BARRIER_H
+#define _BARRIER_H
+
+#include "thread.h"
+
+typedef struct barrier_t {
+    unsigned parties;       // number of threads that meet at the barrier
+    unsigned arrived;       // threads waiting in this round
+    thread_mask_t waiters;  // threads blocked in barrier_wait
+    thread_mask_t released; // woken waiters that have not run since
+} barrier_t;
+
+/** @brief Initialize the barrier pointed to by b
+ *  @param b Barrier to initialize
+ *  @param parties Number of threads that must call barrier_wait
+ *  @return 0 on success, a negative integer on error
+ */
+int barrier_init(barrier_t *b, unsigned parties);
+
+/** @brief Wait until all parties have arrived at barrier b
+ *  @param b Barrier to wait at
+ *  @return Void
+ *
+ *  All but the last thread to arrive block. The last one wakes the others
+ *  and continues, and the barrier is ready for the next round. As with
+ *  thread_block, a thread that blocked executes its current task again
+ *  from the start, and this time barrier_wait returns.
+ */
+void barrier_wait(barrier_t *b);
+
+#endif
@@ -3,15 +3,76 @@
 
 #include <stddef.h>
 #include <stdint.h>
-
+#include <string.h>
+
+#ifdef LIBCHAIN_HOST
+#include "host.h"
+// Field offsets are computed on void_type_t, so every value must start at
+// the same offset from its metadata regardless of its own alignment
+#define VAR_META_ALIGN __attribute__((aligned(sizeof(void *))))
+#else
 #include <libmsp/mem.h>
+#define VAR_META_ALIGN
+#endif
 
 #include "repeat.h"
 
+#ifdef LIBCHAIN_TRACE
+#include "trace.h"
+#endif
+
 #define TASK_NAME_SIZE 32
 #define CHAN_NAME_SIZE 32
 
-#define MAX_DIRTY_SELF_FIELDS 8
+/** @brief Max number of task_nv_write calls in one task execution */
+#ifndef UNDO_LOG_SIZE
+#define UNDO_LOG_SIZE 32
+#endif
+
+/** @brief Min number of words of the written masks of time regions that
+ *         the prologue sweeps on every transition (see TIME_REGION) */
+#ifndef TIME_REBASE_STEP
+#define TIME_REBASE_STEP 1
+#endif
+
+/** @brief Number of entries in the latest-writer index (power of two) */
+#ifndef CHAN_LATEST_SLOTS
+#define CHAN_LATEST_SLOTS 16
+#endif
+
+/** @brief Logical time and its wrap around
+ *  @details The time ticks on every transition and wraps around (in
+ *           minutes on a 16-bit target). Stored times (timestamps) keep
+ *           the low bits of the time, and are compared as serial numbers:
+ *           a is after b if it is less than CHAIN_TIME_HALF ahead. For
+ *           that to hold, the runtime sweeps the stored times, a few on
+ *           every transition (see TIME_REGION): every pass of the sweep
+ *           takes an edge, CHAIN_TIME_WINDOW behind the current time, and
+ *           sets CHAIN_TIME_OLD in the times older than that. Old times
+ *           keep their low bits, and are compared among themselves, so two
+ *           old values keep their order, and any newer value is after them.
+ *           Old times more than CHAIN_TIME_HORIZON behind the edge are
+ *           moved up to that, so only values that are both older than the
+ *           window plus the horizon look as old as each other.
+ *
+ *           Comparisons apply the edge of the current pass (see
+ *           chain_time_effective), so they do not depend on where the
+ *           sweep is: a time the pass has not reached yet compares as it
+ *           will once it has been.
+ *
+ *           CHAIN_TIME_NEVER is the timestamp of a var that was never
+ *           written, which is older than any other time. The logical time
+ *           skips the values that it would be stored as.
+ */
+#define CHAIN_TIME_NEVER 0U
+
+#ifndef CHAIN_TIME_WINDOW
+#define CHAIN_TIME_WINDOW (CHAIN_TIME_HALF / 4)
+#endif
+
+#ifndef CHAIN_TIME_HORIZON
+#define CHAIN_TIME_HORIZON (CHAIN_TIME_HALF / 2)
+#endif
 
 /* Dummy types for offset calculations */
 struct _void_type_t {
@@ -21,11 +82,19 @@ struct _void_type_t {
 typedef struct _void_type_t void_type_t;
 
 typedef void (task_func_t)(void);
+#ifdef LIBCHAIN_TIME16
+typedef uint16_t chain_time_t;  // as on the MSP430, to test the wrap around
+#else
 typedef unsigned chain_time_t;
+#endif
 typedef uint32_t task_mask_t;
 typedef uint16_t field_mask_t;
 typedef unsigned task_idx_t;
 
+#define CHAIN_TIME_OLD  ((chain_time_t)((chain_time_t)~(chain_time_t)0 >> 1) + 1U)
+#define CHAIN_TIME_MASK (CHAIN_TIME_OLD - 1U)
+#define CHAIN_TIME_HALF ((CHAIN_TIME_MASK >> 1) + 1U)
+
 typedef enum {
     CHAN_TYPE_T2T,
     CHAN_TYPE_SELF,
@@ -34,6 +103,7 @@ typedef enum {
     CHAN_TYPE_GLOBAL,
 	CHAN_TYPE_CALL,
     CHAN_TYPE_RETURN,
+    CHAN_TYPE_QUEUE,
 } chan_type_t;
 
 // TODO: include diag fields only when diagnostics are enabled
@@ -49,14 +119,10 @@ typedef struct _chan_meta_t {
 
 typedef struct _var_meta_t {
     chain_time_t timestamp;
-} var_meta_t;
-
-typedef struct _global_field_meta_t{
-		//A placeholder for now...
-		unsigned test;
-} global_field_meta_t;
+} VAR_META_ALIGN var_meta_t;
 
 typedef struct _self_field_meta_t {
+#ifndef LIBCHAIN_SELF_EPOCH
     // Single word (two bytes) value that contains
     // * bit 0: dirty bit (i.e. swap needed)
     // * bit 1: index of the current var buffer from the double buffer pair
@@ -65,29 +131,96 @@ typedef struct _self_field_meta_t {
     // at the same time (atomically) clear the dirty bit.  The dirty bit must
     // be reset in bit 4 before the next swap.
     unsigned idx_pair;
+#else
+    // * bit 0: index of the var written last (SELF_CHAN_IDX_BIT_LAST)
+    // * bit 2: global field (SELF_CHAN_IDX_BIT_GLOBAL)
+    // The var written last is staged while its timestamp is the current
+    // time, and committed once the time moves on, see chan_field_var.
+    unsigned idx_pair;
+    unsigned var_size;      // set by the first write, for the rollback
+#endif
 } self_field_meta_t;
 
+/** @brief Global fields are double-buffered like self fields
+ *  @details With SELF_CHAN_IDX_BITS_GLOBAL set in the index pair: their
+ *           channels go to a dirty list that is not per task but shared
+ *           (see self_field_dirty).
+ */
+typedef self_field_meta_t global_field_meta_t;
+
+/** @brief Dirty tracking of a self channel
+ *  @details Follows the data of the channel, and is followed by a mask
+ *           with a bit for every SELF_FIELD_ALIGN bytes of the data, that
+ *           is, a bit for every possible start of a self field. A chan_out
+ *           sets the bit of the field, and the first one in a task
+ *           execution links the channel into the dirty list of the task.
+ *
+ *           With LIBCHAIN_SELF_EPOCH, the header holds the time of the task
+ *           execution that listed the channel instead of a flag: the channel
+ *           is listed, and the mask valid, only while that time is current.
+ */
+typedef struct _self_chan_dirty_t {
+    struct _self_chan_dirty_t *next;
+    unsigned data_offset;   // from the data of the channel to this header
+    unsigned num_words;     // of the mask
+#ifndef LIBCHAIN_SELF_EPOCH
+    volatile unsigned listed;
+#else
+    volatile chain_time_t time;
+#endif
+} self_chan_dirty_t;
+
+#ifdef LIBCHAIN_STATS
+/** @brief Counter of the runtime statistics, see stats.h */
+typedef uint32_t stat_count_t;
+
+/** @brief Counters of a task (LIBCHAIN_STATS) */
+typedef struct {
+    stat_count_t executions;    // started by a transition
+    stat_count_t reexecutions;  // started again after a reboot
+    stat_count_t chan_out_bytes;
+} task_stats_t;
+#endif
+
 typedef struct {
     task_func_t *func;
     task_mask_t mask;
     task_idx_t idx;
 
-    // Dirty self channel fields are ones to which there had been a
+    // Self channels with dirty fields, ones to which there had been a
     // chan_out. The out value is "staged" in the alternate buffer of
     // the self-channel double-buffer pair for each field. On transition,
     // the buffer index is flipped for dirty fields.
-    self_field_meta_t *dirty_self_fields[MAX_DIRTY_SELF_FIELDS];
-    volatile unsigned num_dirty_self_fields;
+    self_chan_dirty_t * volatile dirty_self_chans;
 
     volatile chain_time_t last_execute_time; // to execute prologue only once
 
     char name[TASK_NAME_SIZE];
+
+#ifdef LIBCHAIN_STATS
+    task_stats_t stats;
+#endif
 } task_t;
 
+/** @brief Declared endpoints of a multicast channel
+ *  @details Stored after the data, so that the channel has the layout of
+ *           a T2T channel up to the data and goes through the same code.
+ */
+typedef struct _mc_meta_t {
+    task_t *src;
+    task_t * const *dests;
+    unsigned num_dests;
+} mc_meta_t;
+
 #define SELF_CHAN_IDX_BIT_DIRTY_CURRENT  0x0001U
 #define SELF_CHAN_IDX_BIT_DIRTY_NEXT     0x0100U
 #define SELF_CHAN_IDX_BIT_CURRENT        0x0002U
 #define SELF_CHAN_IDX_BIT_NEXT           0x0200U
+// Set in both bytes, so that the swap keeps it
+#define SELF_CHAN_IDX_BIT_GLOBAL         0x0004U
+#define SELF_CHAN_IDX_BITS_GLOBAL        0x0404U
+// With LIBCHAIN_SELF_EPOCH, instead of the bits above but GLOBAL
+#define SELF_CHAN_IDX_BIT_LAST           0x0001U
 
 #define VAR_TYPE(type) \
     struct { \
@@ -95,22 +228,58 @@ typedef struct {
         type value; \
     } \
 
+/* The trailing value_type member takes no space (it sits at or before the
+ * padded end of the struct) and only records the declared type of the field
+ * for CHAN_CHECK_TYPE. */
 #define FIELD_TYPE(type) \
     struct { \
         VAR_TYPE(type) var; \
+        type value_type[0]; \
     }
 
 #define SELF_FIELD_TYPE(type) \
     struct { \
         self_field_meta_t meta; \
         VAR_TYPE(type) var[2]; \
+        type value_type[0]; \
     }
 
 #define GLOBAL_FIELD_TYPE(type) \
-		struct { \
-				glob_field_meta_t meta; \
-				VAR_TYPE(type) var; \
-		}
+    struct { \
+        global_field_meta_t meta; \
+        VAR_TYPE(type) var[2]; \
+        type value_type[0]; \
+    }
+
+/** @brief Granularity of the dirty mask of self channels: every self field
+ *         starts at a multiple of it */
+#define SELF_FIELD_ALIGN _Alignof(SELF_FIELD_TYPE(uint8_t))
+
+#define SELF_CHAN_MASK_BITS (sizeof(unsigned) * 8)
+#define SELF_CHAN_MASK_WORDS(type) \
+    (sizeof(struct type) / SELF_FIELD_ALIGN / SELF_CHAN_MASK_BITS + 1)
+
+/** @brief Offset of the dirty header from the data of a self channel */
+#define SELF_CHAN_DIRTY_OFFSET(data_size) \
+    (((data_size) + _Alignof(self_chan_dirty_t) - 1) & \
+     ~(_Alignof(self_chan_dirty_t) - 1))
+
+#define SELF_CHAN_DIRTY_MASK(dirty) ((unsigned *)((dirty) + 1))
+
+/** @brief Layout of self (and scheduler) channels
+ *  @details The data is aligned like the dirty header, so that the header
+ *           is at SELF_CHAN_DIRTY_OFFSET from it, whatever the alignment
+ *           of the channel.
+ */
+#define SELF_CH_TYPE(src, dest, type) \
+    struct _ch_type_ ## src ## _ ## dest ## _ ## type { \
+        chan_meta_t meta; \
+        struct type data __attribute__((aligned(_Alignof(self_chan_dirty_t)))); \
+        struct { \
+            self_chan_dirty_t hdr; \
+            unsigned mask[SELF_CHAN_MASK_WORDS(type)]; \
+        } dirty; \
+    }
 
 #define CH_TYPE(src, dest, type) \
 		struct _ch_type_ ## src ## _ ## dest ## _ ## type { \
@@ -118,6 +287,13 @@ typedef struct {
         struct type data; \
     }
 
+#define MC_TYPE(src, name, type) \
+    struct _ch_type_mc_ ## src ## _ ## name ## _ ## type { \
+        chan_meta_t meta; \
+        struct type data; \
+        mc_meta_t mc; \
+    }
+
 /** @brief Declare a value transmittable over a channel
  *  @param  type    Type of the field value
  *  @param  name    Name of the field, include [] suffix to declare an array
@@ -135,6 +311,8 @@ typedef struct {
 #define CHAN_FIELD_ARRAY(type, name, size)      FIELD_TYPE(type) name[size]
 #define SELF_CHAN_FIELD(type, name)             SELF_FIELD_TYPE(type) name
 #define SELF_CHAN_FIELD_ARRAY(type, name, size) SELF_FIELD_TYPE(type) name[size]
+#define GLOBAL_CHAN_FIELD(type, name)             GLOBAL_FIELD_TYPE(type) name
+#define GLOBAL_CHAN_FIELD_ARRAY(type, name, size) GLOBAL_FIELD_TYPE(type) name[size]
 
 /** @brief Execution context */
 typedef struct _context_t {
@@ -144,12 +322,50 @@ typedef struct _context_t {
     /** @brief Logical time, ticks at task boundaries */
     chain_time_t time;
 
+    /** @brief Slot of the running thread, see thread.h (0 if single-threaded)
+     *  @details Every slot has its own pair of contexts (see
+     *           transition_to_thread), so this is fixed for a context.
+     */
+    unsigned thread;
+
     // TODO: move this to top, just feels cleaner
     struct _context_t *next_ctx;
 } context_t;
 
 extern context_t * volatile curctx;
 
+/** @brief Memory that holds stored times, for the sweep that rebases them
+ *  @details Declared for every channel and task (see TIME_REGION). The
+ *           written mask has a bit for every _Alignof(chain_time_t) bytes
+ *           of the region, which is set on the first write of a time there
+ *           (see timestamp_track). The sweep walks the regions, in the
+ *           order the linker put them, and the set bits.
+ */
+typedef struct {
+    uint8_t *start;
+    unsigned size;
+    unsigned *written;
+} time_region_t;
+
+#define TIME_REGION_BITS (sizeof(unsigned) * 8)
+#define TIME_REGION_WORDS(size) \
+    ((size) / _Alignof(chain_time_t) / TIME_REGION_BITS + 1)
+
+/** @brief Declare the time region of an object: its written mask, and its
+ *         entry in the table of regions, a linker section
+ *  @details The alignment of the entry is given, as the compiler may raise
+ *           it, which would leave gaps in the table.
+ *  @param name Prefix of the symbols of the two
+ *  @param obj  The object, or the part of it that holds the times
+ */
+#define TIME_REGION(name, obj) TIME_REGION_INNER(name, obj)
+#define TIME_REGION_INNER(name, obj) \
+    __nv unsigned name ## _written[TIME_REGION_WORDS(sizeof(obj))]; \
+    static const time_region_t name ## _time_region \
+        __attribute__((section("chain_time_regions"), used, \
+                       aligned(_Alignof(time_region_t)))) = \
+        { (uint8_t *)&(obj), sizeof(obj), name ## _written }
+
 /** @brief Internal macro for constructing name of task symbol */
 #define TASK_SYM_NAME(func) _task_ ## func
 
@@ -170,11 +386,13 @@ extern context_t * volatile curctx;
  */
 #define TASK(idx, func) \
     void func(); \
-    __nv task_t TASK_SYM_NAME(func) = { func, (1UL << idx), idx, {0}, 0, 0, #func }; \
+    __nv task_t TASK_SYM_NAME(func) = { func, (1UL << idx), idx, NULL, 0, #func }; \
+    TIME_REGION(TASK_SYM_NAME(func), TASK_SYM_NAME(func).last_execute_time); \
 
 #define TASK_EXT(idx, func) \
     void func(); \
-    __nv task_t TASK_SYM_NAME(func) = { func, (3UL << idx), idx, {0}, 0, 0, #func }; \
+    __nv task_t TASK_SYM_NAME(func) = { func, (3UL << idx), idx, NULL, 0, #func }; \
+    TIME_REGION(TASK_SYM_NAME(func), TASK_SYM_NAME(func).last_execute_time); \
 
 #define TASK_REF(func) &TASK_SYM_NAME(func)
 
@@ -227,6 +445,68 @@ void _init();
 
 void task_prologue();
 void transition_to(task_t *task);
+
+/** @brief Transfer control to the given thread
+ *  @param task     Task at which the current thread continues
+ *  @param thread   Slot of the thread to run next
+ *  @details Like transition_to, if thread is the current one. Otherwise the
+ *           current thread continues at task only when it is switched back
+ *           to, and the given thread continues where it was switched out
+ *           (or created). Each thread has its own pair of contexts, and the
+ *           switch is the same flip of curctx as a transition, to the
+ *           unused context of the given thread.
+ */
+void transition_to_thread(task_t *task, unsigned thread);
+
+/** @brief Write a word of shared non-volatile state from a task
+ *  @details For state outside of channels that must change together with
+ *           the task that changes it (e.g. thread and lock bookkeeping).
+ *           The old value is logged first, and if the task is restarted
+ *           after a reboot, the prologue restores all words it had written,
+ *           so the task takes effect exactly once: when it transitions.
+ */
+void task_nv_write(volatile unsigned *word, unsigned value);
+
+/** @brief Value of a word at the start of the running task execution
+ *  @details That is, the value a rollback would restore, if the execution
+ *           changed it with task_nv_write, or else its current value.
+ */
+unsigned task_nv_initial(volatile unsigned *word);
+
+/** @brief Discard the effects of the running task execution so far
+ *  @details Restores the words written with task_nv_write and drops the
+ *           pending self-channel swaps, as the prologue does for a task
+ *           restarted by a reboot. For tasks that stop half-way and will
+ *           be executed again from the start (see thread_block).
+ */
+void task_rollback();
+
+/** @brief Mark a self field dirty, on its first write in a task execution
+ *  @param dirty    dirty header of the channel of the field
+ *  @details The channel is linked into the dirty list of the running task,
+ *           or for a global field, into the list shared by all tasks.
+ *  @param word     word of the mask with the bit of the field
+ *  @param bit      the bit of the field
+ *  @param field    the field
+ */
+void self_field_dirty(self_chan_dirty_t *dirty, unsigned *word, unsigned bit,
+                      self_field_meta_t *field);
+/** @brief Stage a self field, on its first write in a task execution, with
+ *         LIBCHAIN_SELF_EPOCH
+ *  @details Lists the channel, with a clear mask, if the running task
+ *           execution has not yet, sets the bit of the field and then makes
+ *           the just stamped var the one written last.
+ *  @param var_size size of a var of the field, kept for task_rollback
+ */
+void self_field_stage(self_chan_dirty_t *dirty, unsigned *word, unsigned bit,
+                      self_field_meta_t *field, unsigned var_size);
+/** @brief Check that the running task is an endpoint of a multicast channel
+ *  @details Used by MC_IN_CH and MC_OUT_CH with diagnostics enabled. Halts
+ *           if the task is not a destination (out = 0) or the source (out
+ *           non-zero) of the channel.
+ *  @return meta, which is the start of the channel
+ */
+void *mc_access(chan_meta_t *meta, const mc_meta_t *mc, int out);
 void *chan_in(const char *field_name, size_t var_size, int count, ...);
 void chan_out(const char *field_name, const void *value,
               size_t var_size, int count, ...);
@@ -240,43 +520,92 @@ void chan_out(const char *field_name, const void *value,
  *           one for each field, in order of the declaration of the fields.
  *           Each initializer is either
  *             * SELF_FIELD_INITIALIZER, or
- *             * SELF_FIELD_ARRAY_INITIALIZER(count) [only count=2^n supported]
+ *             * SELF_FIELD_ARRAY_INITIALIZER(count)
+ *           or, for global channels, the GLOBAL_ counterparts.
  */
 
+#ifndef LIBCHAIN_SELF_EPOCH
 #define SELF_FIELD_META_INITIALIZER { (SELF_CHAN_IDX_BIT_NEXT) }
+#else
+#define SELF_FIELD_META_INITIALIZER { 0, 0 }
+#endif
 #define SELF_FIELD_INITIALIZER { SELF_FIELD_META_INITIALIZER }
 
-#define SELF_FIELD_ARRAY_INITIALIZER(count) { REPEAT(count, SELF_FIELD_INITIALIZER) }
+#define SELF_FIELD_ARRAY_INITIALIZER(count) \
+    { [0 ... (count) - 1] = SELF_FIELD_INITIALIZER }
+
+#ifndef LIBCHAIN_SELF_EPOCH
+#define GLOBAL_FIELD_META_INITIALIZER \
+    { (SELF_CHAN_IDX_BIT_NEXT | SELF_CHAN_IDX_BITS_GLOBAL) }
+#else
+#define GLOBAL_FIELD_META_INITIALIZER { (SELF_CHAN_IDX_BIT_GLOBAL), 0 }
+#endif
+#define GLOBAL_FIELD_INITIALIZER { GLOBAL_FIELD_META_INITIALIZER }
+
+#define GLOBAL_FIELD_ARRAY_INITIALIZER(count) \
+    { [0 ... (count) - 1] = GLOBAL_FIELD_INITIALIZER }
 
 #define SELF_FIELDS_INITIALIZER_INNER(type) FIELD_INIT_ ## type
 #define SELF_FIELDS_INITIALIZER(type) SELF_FIELDS_INITIALIZER_INNER(type)
 
-/** @brief sets up a channel with threads*/
+#define SELF_CHAN_DIRTY_INITIALIZER(type) \
+    { { NULL, SELF_CHAN_DIRTY_OFFSET(sizeof(struct type)), \
+        SELF_CHAN_MASK_WORDS(type), 0 } }
+
+/** @brief sets up a channel with threads
+ *  @details One instance per call; see THREAD_CHANNEL in thread.h for an
+ *           instance per thread slot.
+ */
 #define CHANNEL_WT(src, dest, id, type) \
 		__nv CH_TYPE(src, dest, type) _ch_ ## src ## _ ## dest ## _ ## id = \
-				{ { CHAN_TYPE_T2T, { #src, #dest } } }
+				{ { CHAN_TYPE_T2T, { #src, #dest } } }; \
+    TIME_REGION(_ch_ ## src ## _ ## dest ## _ ## id, \
+                _ch_ ## src ## _ ## dest ## _ ## id)
 
 #define CHANNEL(src, dest, type) \
     __nv CH_TYPE(src, dest, type) _ch_ ## src ## _ ## dest = \
-        { { CHAN_TYPE_T2T, { #src, #dest } } }
+        { { CHAN_TYPE_T2T, { #src, #dest } } }; \
+    TIME_REGION(_ch_ ## src ## _ ## dest, _ch_ ## src ## _ ## dest)
 
 #define SELF_CHANNEL(task, type) \
-    __nv CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
-        { { CHAN_TYPE_SELF, { #task, #task } }, SELF_FIELDS_INITIALIZER(type) }
+    __nv SELF_CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
+        { { CHAN_TYPE_SELF, { #task, #task } }, SELF_FIELDS_INITIALIZER(type), \
+          SELF_CHAN_DIRTY_INITIALIZER(type) }; \
+    TIME_REGION(_ch_ ## task ## _ ## task, _ch_ ## task ## _ ## task)
 
 #define SELF_CHANNEL_DEC(task, type) \
-		CH_TYPE(task, task, type) _ch_ ## task ## _ ## task
+		SELF_CH_TYPE(task, task, type) _ch_ ## task ## _ ## task
 
 #define SCHEDULER_CHANNEL(task, type) \
-    __nv CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
-        { { CHAN_TYPE_SCHEDULER, { #task, #task } }, SELF_FIELDS_INITIALIZER(type) }
+    __nv SELF_CH_TYPE(task, task, type) _ch_ ## task ## _ ## task = \
+        { { CHAN_TYPE_SCHEDULER, { #task, #task } }, SELF_FIELDS_INITIALIZER(type), \
+          SELF_CHAN_DIRTY_INITIALIZER(type) }; \
+    TIME_REGION(_ch_ ## task ## _ ## task, _ch_ ## task ## _ ## task)
 
 #define SCHEDULER_CHANNEL_DEC(task, type) \
-        CH_TYPE(task, task, type) _ch_ ## task ## _ ## task
+        SELF_CH_TYPE(task, task, type) _ch_ ## task ## _ ## task
+
+/** @brief Declare a global channel: state that any task of any thread
+ *         reads and writes
+ *  @details The fields are declared with GLOBAL_CHAN_FIELD and are double
+ *           buffered like self fields. A CHAN_OUT stages the value, which
+ *           the writing task itself reads back from then on; all other
+ *           tasks keep reading the previous value until the writer
+ *           transitions, and if it is restarted instead, the staged values
+ *           are dropped. The var timestamps are the versions of the
+ *           values: the time of the task that committed them.
+ *
+ *           Like for self channels, the application defines FIELD_INIT_type
+ *           with a GLOBAL_FIELD_INITIALIZER for each field. The channel has
+ *           the layout of a self channel, as the fields go through the same
+ *           code, dirty mask included.
+ */
+#define GLOBAL_CHANNEL(name, type) \
+    __nv SELF_CH_TYPE(glob, name, type) _ch_glob_ ## name = \
+        { { CHAN_TYPE_GLOBAL, { "glob", #name } }, SELF_FIELDS_INITIALIZER(type), \
+          SELF_CHAN_DIRTY_INITIALIZER(type) }; \
+    TIME_REGION(_ch_glob_ ## name, _ch_glob_ ## name)
 
-#define GLOBAL_CHANNEL(task, type) \
-		__nv CH_TYPE(task, glob, type) _ch_ ## task ## _glob = \
-				{ { CHAN_TYPE_GLOB, { :
 /** @brief Declare a channel for passing arguments to a callable task
  *  @details Callers would output values into this channels before
  *           transitioning to the callable task.
@@ -288,10 +617,12 @@ void chan_out(const char *field_name, const void *value,
  * */
 #define CALL_CHANNEL(callee, type) \
     __nv CH_TYPE(caller, callee, type) _ch_call_ ## callee = \
-        { { CHAN_TYPE_CALL, { #callee, "call:"#callee } } }
+        { { CHAN_TYPE_CALL, { #callee, "call:"#callee } } }; \
+    TIME_REGION(_ch_call_ ## callee, _ch_call_ ## callee)
 #define RET_CHANNEL(callee, type) \
     __nv CH_TYPE(caller, callee, type) _ch_ret_ ## callee = \
-        { { CHAN_TYPE_RETURN, { #callee, "ret:"#callee } } }
+        { { CHAN_TYPE_RETURN, { #callee, "ret:"#callee } } }; \
+    TIME_REGION(_ch_ret_ ## callee, _ch_ret_ ## callee)
 
 /** @brief Delcare a channel for receiving results from a callable task
  *  @details Callable tasks output values into this channel, and a
@@ -302,24 +633,54 @@ void chan_out(const char *field_name, const void *value,
  */
 #define RETURN_CHANNEL(callee, type) \
     __nv CH_TYPE(caller, callee, type) _ch_ret_ ## callee = \
-        { { CHAN_TYPE_RETURN, { #callee, "ret:"#callee } } }
+        { { CHAN_TYPE_RETURN, { #callee, "ret:"#callee } } }; \
+    TIME_REGION(_ch_ret_ ## callee, _ch_ret_ ## callee)
 
 /** @brief Declare a multicast channel: one source many destinations
  *  @params name    short name used to refer to the channels from source and destinations
- *  @details Conceptually, the channel is between the specified source and
- *           destinations only. The arbitrary name exists only to simplify referring
- *           to the channel: to avoid having to list all sources and destinations
- *           every time. However, access control is not currently enforced.
- *           Declarations of sources and destinations is necessary for perform
- *           compile-time checks planned for the future.
+ *  @params dest    destination tasks, up to 8
+ *  @details The channel stores one copy of each field, so a CHAN_OUT to it
+ *           costs the same as to a T2T channel whatever the number of
+ *           destinations, and every destination reads that copy with
+ *           CHAN_IN. The arbitrary name exists only to simplify referring
+ *           to the channel: to avoid having to list all sources and
+ *           destinations every time.
+ *
+ *           The source and destinations are recorded in the channel (see
+ *           mc_meta_t). MC_IN_CH and MC_OUT_CH fail to compile for a task
+ *           that was not declared in that role, and with diagnostics
+ *           enabled, the runtime also checks that the running task is the
+ *           one it claims to be. The source cannot be a destination too:
+ *           that fails to compile as a redeclared endpoint.
  */
 #define MULTICAST_CHANNEL(type, name, src, dest, ...) \
-    __nv CH_TYPE(src, name, type) _ch_mc_ ## src ## _ ## name = \
-        { { CHAN_TYPE_MULTICAST, { #src, "mc:" #name } } }
+    MC_SOURCE_DECL(_ch_mc_ ## src ## _ ## name, src) \
+    FOR_EACH(MC_ENDPOINT_DECL, _ch_mc_ ## src ## _ ## name, dest, ##__VA_ARGS__) \
+    __nv MC_TYPE(src, name, type) _ch_mc_ ## src ## _ ## name = \
+        { .meta = { CHAN_TYPE_MULTICAST, { #src, "mc:" #name } }, \
+          .mc = { TASK_REF(src), \
+            (task_t * const []){ FOR_EACH(MC_ENDPOINT_REF, _, dest, ##__VA_ARGS__) }, \
+            NUM_CHANS(FOR_EACH(MC_ENDPOINT_REF, _, dest, ##__VA_ARGS__)) } }; \
+    TIME_REGION(_ch_mc_ ## src ## _ ## name, _ch_mc_ ## src ## _ ## name)
+
+/** @brief Internal: declare the task symbol of the source or a destination
+ *         of channel ch, and constants that exist only for the declared
+ *         role. The _endpoint_ constant is declared for either role, so
+ *         that a task listed twice is a compile error. */
+#define MC_SOURCE_DECL(ch, task) \
+    extern task_t TASK_SYM_NAME(task); \
+    enum { ch ## _from_ ## task = 1, ch ## _endpoint_ ## task = 1 };
+#define MC_ENDPOINT_DECL(ch, task) \
+    extern task_t TASK_SYM_NAME(task); \
+    enum { ch ## _to_ ## task = 1, ch ## _endpoint_ ## task = 1 };
+#define MC_ENDPOINT_REF(unused, task) TASK_REF(task),
+#define MC_SOURCE_CHECK(ch, task) + ch ## _from_ ## task
+#define MC_ENDPOINT_CHECK(ch, task) + ch ## _to_ ## task
 
 #define CH_TH(src,dest, thr) (&_ch_ ## src ## _ ## dest ## _ ## thr)
 
 #define CH(src, dest) (&_ch_ ## src ## _ ## dest)
+#define GLOBAL_CH(name) (&_ch_glob_ ## name)
 #define SELF_CH(tsk)  CH(tsk, tsk)
 
 /* For compatibility */
@@ -356,46 +717,452 @@ void chan_out(const char *field_name, const void *value,
  *           channel (task-to-task/self/multicast) be transparent to the
  *           application. type nature be transparent , or we use a name.
  */
-#define MC_IN_CH(name, src, dest)         (&_ch_mc_ ## src ## _ ## name)
-#define MC_OUT_CH(name, src, dest, ...)   (&_ch_mc_ ## src ## _ ## name)
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define MC_CH(ch, out, check) \
+    (&ch + 0 * (0 check))
+#else
+#define MC_CH(ch, out, check) \
+    ((__typeof__(&ch))mc_access(&ch.meta, &ch.mc, out + 0 * (0 check)))
+#endif
+
+#define MC_IN_CH(name, src, dest) \
+    MC_CH(_ch_mc_ ## src ## _ ## name, 0, \
+          MC_ENDPOINT_CHECK(_ch_mc_ ## src ## _ ## name, dest))
+#define MC_OUT_CH(name, src, dest, ...) \
+    MC_CH(_ch_mc_ ## src ## _ ## name, 1, \
+          MC_SOURCE_CHECK(_ch_mc_ ## src ## _ ## name, src) \
+          FOR_EACH(MC_ENDPOINT_CHECK, _ch_mc_ ## src ## _ ## name, dest, ##__VA_ARGS__))
 
 /** @brief Internal macro for counting channel arguments to a variadic macro */
 #define NUM_CHANS(...) (sizeof((void *[]){__VA_ARGS__})/sizeof(void *))
 
+/** @brief Compile-time check that type is the declared type of the field,
+ *         as an expression
+ */
+#define CHAN_CHECK_TYPE(type, field, chan) \
+    ((void)sizeof(struct { \
+        _Static_assert(__builtin_types_compatible_p(type, \
+                           __typeof__((chan)->data.field.value_type[0])), \
+                       "type does not match the declared type of the field"); \
+        char unused; \
+    }))
+
+/** @brief Compile-time test for a double-buffered (self or global) field
+ *  @details Self and global fields carry a metadata word and two vars, plain
+ *           fields (T2T, multicast, call/return) a single var, so the size of
+ *           the declared field tells the two layouts apart once the type is
+ *           checked to be the declared one.
+ */
+#define CHAN_FIELD_IS_SELF(type, field, chan) \
+    (CHAN_CHECK_TYPE(type, field, chan), \
+     sizeof((chan)->data.field) != sizeof(FIELD_TYPE(type)))
+
+/** @brief Edge of the current pass of the sweep, see CHAIN_TIME_WINDOW */
+extern volatile chain_time_t chain_time_edge;
+
+/** @brief The current time, as it is stored */
+static inline chain_time_t chain_time_stamp()
+{
+    return curctx->time & CHAIN_TIME_MASK;
+}
+
+/** @brief Locate the var of a field: the only one for plain fields, or the
+ *         one selected by idx_bit (CURRENT/NEXT) for self fields
+ *  @details With 'self' a compile-time constant this folds to an address
+ *           computation, plus one load of the index pair for self fields.
+ *           A global field that the running task has written is read from
+ *           the staged (NEXT) var.
+ *
+ *           With LIBCHAIN_SELF_EPOCH, the var written last is staged if the
+ *           running task execution stamped it, and committed otherwise.
+ *           CURRENT is then the other var of a staged self field, and NEXT
+ *           the staged var, or the other one to stage a new value in.
+ */
+static inline var_meta_t *chan_field_var(uint8_t *field, size_t var_size,
+                                         int self, unsigned idx_bit)
+{
+    if (!self)
+        return (var_meta_t *)(field + offsetof(FIELD_TYPE(void_type_t), var));
+
+    self_field_meta_t *self_field = (self_field_meta_t *)field;
+    unsigned idx_pair = self_field->idx_pair;
+
+#ifdef LIBCHAIN_SELF_EPOCH
+    uint8_t *vars = field + offsetof(SELF_FIELD_TYPE(void_type_t), var);
+    unsigned last = idx_pair & SELF_CHAN_IDX_BIT_LAST;
+    var_meta_t *cur = (var_meta_t *)(vars + (last ? var_size : 0));
+    int staged = cur->timestamp == chain_time_stamp();
+
+    if (idx_bit == SELF_CHAN_IDX_BIT_NEXT ? staged :
+            !staged || (idx_pair & SELF_CHAN_IDX_BIT_GLOBAL))
+        return cur;
+    return (var_meta_t *)(vars + (last ? 0 : var_size));
+#else
+    if ((idx_pair & (SELF_CHAN_IDX_BIT_GLOBAL | SELF_CHAN_IDX_BIT_DIRTY_CURRENT)) ==
+            (SELF_CHAN_IDX_BIT_GLOBAL | SELF_CHAN_IDX_BIT_DIRTY_CURRENT))
+        idx_bit = SELF_CHAN_IDX_BIT_NEXT;
+
+    unsigned var_offset = (idx_pair & idx_bit) ? var_size : 0;
+
+    return (var_meta_t *)(field +
+            offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
+#endif
+}
+
+/** @brief Whether a is after b, of two times without CHAIN_TIME_OLD */
+static inline int chain_time_serial_after(chain_time_t a, chain_time_t b)
+{
+    return (chain_time_t)(((a - b) & CHAIN_TIME_MASK) - 1U) <
+           CHAIN_TIME_HALF - 1U;
+}
+
+/** @brief A stored time as the sweep leaves it in the current pass */
+static inline chain_time_t chain_time_effective(chain_time_t t)
+{
+    chain_time_t edge = chain_time_edge;
+    chain_time_t horizon = (edge - CHAIN_TIME_HORIZON) & CHAIN_TIME_MASK;
+
+    if (!(t & CHAIN_TIME_OLD)) {
+        if (!chain_time_serial_after(edge, t))
+            return t;
+        t |= CHAIN_TIME_OLD;
+    }
+    if (chain_time_serial_after(horizon, t & CHAIN_TIME_MASK))
+        t = CHAIN_TIME_OLD | horizon;
+    return t;
+}
+
+/** @brief Whether time a is after time b, see CHAIN_TIME_WINDOW */
+static inline int chain_time_after(chain_time_t a, chain_time_t b)
+{
+    if (a == CHAIN_TIME_NEVER || b == CHAIN_TIME_NEVER)
+        return b == CHAIN_TIME_NEVER && a != CHAIN_TIME_NEVER;
+
+    a = chain_time_effective(a);
+    b = chain_time_effective(b);
+    if ((a ^ b) & CHAIN_TIME_OLD)
+        return !(a & CHAIN_TIME_OLD);
+    return chain_time_serial_after(a & CHAIN_TIME_MASK, b & CHAIN_TIME_MASK);
+}
+
+/** @brief Of two vars, the most recently written one (the first on a tie) */
+static inline var_meta_t *chan_var_latest(var_meta_t *a, var_meta_t *b)
+{
+    return chain_time_after(b->timestamp, a->timestamp) ? b : a;
+}
+
+/** @brief Have the sweep rebase a stored time from now on
+ *  @details For times that are compared, or checked for equality, with the
+ *           current time long after they were stored. Called when it is
+ *           first set: it marks it in the written mask of the time region
+ *           that holds it (see TIME_REGION). A time outside of every region
+ *           is not rebased, and can compare wrong once it gets old.
+ */
+void timestamp_track(chain_time_t *timestamp);
+
+/** @brief Stamp a var as written by the running task execution */
+static inline void chan_var_stamp(var_meta_t *var)
+{
+    if (var->timestamp == CHAIN_TIME_NEVER)
+        timestamp_track(&var->timestamp);
+    var->timestamp = chain_time_stamp();
+}
+
+/** @brief Latest-writer index
+ *  @details Every chan_out to a plain (non-self) field records the written
+ *           var in the slot for the field name. A field with many sources
+ *           is read by checking whether the recorded var is one of the
+ *           sources passed to CHAN_IN: if it is, no later write went to any
+ *           of them, so it is the latest one. Otherwise (the slot was taken
+ *           by a same-named field of other channels, another element of the
+ *           same array field, or a hash collision)
+ *           the sources are scanned as before.
+ *
+ *           The index is not crash-consistent with the vars. chan_field_out
+ *           stamps the var, copies the value and only then sets the slot, so
+ *           the slot never names a partly written var, but a reboot between
+ *           the copy and the slot write leaves it naming the previous writer
+ *           while the new var carries the newer timestamp. This is not
+ *           logged: the interrupted task execution is the one that restarts,
+ *           and it writes the field (and the slot) again before any other
+ *           task can read it. A restarted execution that no longer writes the
+ *           field leaves its var as written by an execution that never
+ *           completed, which a hit on the slot ignores and a scan picks.
+ *
+ *           Self fields are not indexed: their writes become visible only
+ *           on the buffer swap. They are compared against the indexed var.
+ */
+extern var_meta_t * volatile chan_latest[CHAN_LATEST_SLOTS];
+
+/** @brief Slot of a field name in the latest-writer index
+ *  @details Computed from the first four characters of the name of the
+ *           field, not counting an array index, so that it folds to a
+ *           constant for a string literal. All elements of an array field
+ *           share the slot: a var written as v[0] must displace the same
+ *           var recorded when it was written as v[i].
+ */
+#define CHAN_NAME_IN_BASE(name, len, i) \
+    ((i) < (len) && (name)[i] != '[' && (name)[i] != ' ')
+#define CHAN_NAME_HASH(name, len) \
+    (((name)[0] * 3U + \
+      (CHAN_NAME_IN_BASE(name, len, 1) ? (name)[1] * 5U + \
+       (CHAN_NAME_IN_BASE(name, len, 2) ? (name)[2] * 7U + \
+        (CHAN_NAME_IN_BASE(name, len, 3) ? (name)[3] * 11U : 0) : 0) : 0)) \
+        & (CHAN_LATEST_SLOTS - 1))
+#define CHAN_FIELD_SLOT(field) CHAN_NAME_HASH(#field, sizeof(#field) - 1)
+
+/** @brief Of the given vars of one field, the most recently written one
+ *  @param slot       slot of the field name in the latest-writer index
+ *  @param vars       vars of the field in each source channel
+ *  @param count      number of sources
+ *  @param self_mask  bit i set if vars[i] belongs to a self field
+ */
+static inline var_meta_t *chan_var_indexed(unsigned slot,
+        var_meta_t *const vars[], unsigned count, unsigned self_mask)
+{
+    var_meta_t *indexed = chan_latest[slot];
+    var_meta_t *latest = NULL;
+    unsigned i;
+
+    for (i = 0; i < count; ++i) {
+        if (!(self_mask & (1U << i)) && vars[i] == indexed) {
+            latest = indexed;
+            break;
+        }
+    }
+
+    if (!latest) {
+        latest = vars[0];
+        for (i = 1; i < count; ++i)
+            latest = chan_var_latest(latest, vars[i]);
+        return latest;
+    }
+
+    for (i = 0; i < count; ++i) {
+        if (self_mask & (1U << i))
+            latest = chan_var_latest(latest, vars[i]);
+    }
+    return latest;
+}
+
+/** @brief Enqueue a written self field to be flipped on the next transition
+ *  @param dirty    dirty header of the channel
+ *  @param offset   offset of the field in the data of the channel
+ *  @details Only the first write to the field in a task execution finds its
+ *           bit clear and goes to self_field_dirty, which
+ *             (1) links the channel into the dirty list of the task
+ *             (2) sets the bit of the field in the mask
+ *             (3) initializes the dirty bit for next swap, or, in other
+ *                 words, "finalizes" clearing of the dirty bit from the
+ *                 previous swap, since the swap "clears" the dirty bit by
+ *                 moving it over from LSB to MSB, and marks the index dirty
+ *           The channel of a global field goes to the shared dirty list
+ *           instead.
+ *
+ *           With LIBCHAIN_SELF_EPOCH, there is nothing to flip on the
+ *           transition: the first write, to the var that is not the one
+ *           written last, goes to self_field_stage, and later writes find
+ *           the var they stamped already written last.
+ *  @param var      the var just stamped, returned by chan_field_var (NEXT)
+ */
+static inline void chan_self_field_out(self_field_meta_t *self_field,
+                                       self_chan_dirty_t *dirty, size_t offset,
+                                       var_meta_t *var, size_t var_size)
+{
+    unsigned idx = offset / SELF_FIELD_ALIGN;
+    unsigned *word = SELF_CHAN_DIRTY_MASK(dirty) + idx / SELF_CHAN_MASK_BITS;
+    unsigned bit = 1U << (idx % SELF_CHAN_MASK_BITS);
+
+#ifdef LIBCHAIN_SELF_EPOCH
+    uint8_t *last = (uint8_t *)self_field +
+        offsetof(SELF_FIELD_TYPE(void_type_t), var) +
+        ((self_field->idx_pair & SELF_CHAN_IDX_BIT_LAST) ? var_size : 0);
+
+    if ((uint8_t *)var != last)
+        self_field_stage(dirty, word, bit, self_field, var_size);
+#else
+    (void)var;
+    (void)var_size;
+    if (!(*word & bit))
+        self_field_dirty(dirty, word, bit, self_field);
+#endif
+}
+
+/** @brief Write a value into the var of a field
+ *  @param value    value to copy into the var, or NULL to leave it to the
+ *                  caller (see CHAN_OUT_REF)
+ *  @return Pointer to the value in the written var
+ *  @details For self fields, the value is staged in the next buffer (see
+ *           chan_self_field_out). Writes to plain fields are recorded in
+ *           the latest-writer index.
+ */
+static inline void *chan_field_out(uint8_t *field, const void *value,
+                                   size_t value_size, size_t var_size, int self,
+                                   unsigned slot, self_chan_dirty_t *dirty,
+                                   size_t offset)
+{
+    var_meta_t *var = chan_field_var(field, var_size, self,
+                                     SELF_CHAN_IDX_BIT_NEXT);
+    uint8_t *var_value = (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
+
+    chan_var_stamp(var);
+    if (self)
+        chan_self_field_out((self_field_meta_t *)field, dirty, offset,
+                            var, var_size);
+
+    if (value)
+        memcpy(var_value, value, value_size);
+
+    if (!self)
+        chan_latest[slot] = var;
+
+#ifdef LIBCHAIN_STATS
+    curctx->task->stats.chan_out_bytes += value_size;
+#endif
+
+#ifdef LIBCHAIN_TRACE
+    trace_field(TRACE_CHAN_OUT, field - offset -
+                offsetof(CH_TYPE(_sa, _da, _void_type_t), data), offset);
+#endif
+
+#ifdef LIBCHAIN_HOST
+    host_point(HOST_POINT_CHAN_OUT);
+#endif
+
+    return var_value;
+}
+
+/** @brief Internal: var of the given field of a channel */
+#define CHAN_VAR(type, field, chan, idx_bit) \
+    chan_field_var((uint8_t *)&((chan)->data.field), sizeof(VAR_TYPE(type)), \
+                   CHAN_FIELD_IS_SELF(type, field, chan), idx_bit)
+#define CHAN_VAR_IN(type, field, chan) \
+    CHAN_VAR(type, field, chan, SELF_CHAN_IDX_BIT_CURRENT)
+
+/** @brief Internal: pointer to the value in a var returned by CHAN_VAR */
+#define CHAN_VAR_VALUE(type, var) (&((VAR_TYPE(type) *)(var))->value)
+
+/** @brief Internal: dirty header of a self channel (see SELF_CH_TYPE)
+ *  @details Not meaningful for other channels, and only used for self fields.
+ */
+#define CHAN_SELF_DIRTY(chan) \
+    ((self_chan_dirty_t *)((uint8_t *)&(chan)->data + \
+                           SELF_CHAN_DIRTY_OFFSET(sizeof((chan)->data))))
+
+/** @brief Internal: write one field of one channel */
+#define CHAN_FIELD_OUT(type, field, val, chan) \
+    chan_field_out((uint8_t *)&((chan)->data.field), &(val), sizeof(type), \
+                   sizeof(VAR_TYPE(type)), CHAN_FIELD_IS_SELF(type, field, chan), \
+                   CHAN_FIELD_SLOT(field), CHAN_SELF_DIRTY(chan), \
+                   (uint8_t *)&((chan)->data.field) - (uint8_t *)&(chan)->data)
+
+/** @brief Write a field of one channel in place
+ *  @return Pointer (type *) to the value of the var that CHAN_OUT1 would
+ *          copy into: the next buffer of a self or global field, the var
+ *          of any other field
+ *  @details The field counts as written by the running task execution from
+ *           here on, with whatever the caller stores through the pointer
+ *           before the task transitions. This saves building a large value
+ *           (e.g. an element of a CHAN_FIELD_ARRAY of structs) in a local
+ *           just to have it copied. Like with CHAN_OUT, a restarted task
+ *           execution writes the value again, and the pointer must not be
+ *           used past the transition. Not checked against the channel
+ *           endpoints with LIBCHAIN_ENABLE_DIAGNOSTICS, except as done by
+ *           MC_OUT_CH.
+ */
+#define CHAN_OUT_REF(type, field, chan) \
+    ((type *)chan_field_out((uint8_t *)&((chan)->data.field), NULL, sizeof(type), \
+        sizeof(VAR_TYPE(type)), CHAN_FIELD_IS_SELF(type, field, chan), \
+        CHAN_FIELD_SLOT(field), CHAN_SELF_DIRTY(chan), \
+        (uint8_t *)&((chan)->data.field) - (uint8_t *)&(chan)->data))
+
+#ifdef LIBCHAIN_TRACE
+/** @brief Internal: a source channel of a traced read, see trace_chan_in */
+typedef struct {
+    const void *chan;
+    const uint8_t *data;
+    const uint8_t *field;
+} trace_source_t;
+
+/** @brief Record a read of a field of the source that holds the var
+ *  @return The var
+ */
+var_meta_t *trace_chan_in(var_meta_t *var, const trace_source_t *sources,
+                          unsigned count);
+#endif
+
+/** @brief Internal: record a read of a field, with LIBCHAIN_TRACE
+ *  @param ...  the source channels
+ *  @return The var that was read
+ */
+#ifdef LIBCHAIN_TRACE
+#define CHAN_TRACE_SOURCE(field, chan) \
+    { (chan), (uint8_t *)&(chan)->data, (uint8_t *)&(chan)->data.field },
+#define CHAN_TRACE_IN(field, var, ...) \
+    trace_chan_in((var), (const trace_source_t []){ \
+                      FOR_EACH(CHAN_TRACE_SOURCE, field, __VA_ARGS__) }, \
+                  NUM_CHANS(__VA_ARGS__))
+#else
+#define CHAN_TRACE_IN(field, var, ...) (var)
+#endif
+
+/** @brief Internal: CHAN_INn through the latest-writer index */
+#define CHAN_VAR_INDEXED(type, field, count, self_mask, ...) \
+    chan_var_indexed(CHAN_FIELD_SLOT(field), \
+                     (var_meta_t *[]){ __VA_ARGS__ }, count, self_mask)
+#define CHAN_SELF_BIT(type, field, chan, i) \
+    (CHAN_FIELD_IS_SELF(type, field, chan) ? (1U << (i)) : 0U)
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+
 /** @brief Read the most recently modified value from one of the given channels
  *  @details This macro retuns a pointer to the most recently modified value
  *           of the requested field.
  *
- *  NOTE: We pass the channel pointer instead of the field pointer
- *        to have access to diagnostic info. The logic in chain_in
- *        only strictly needs the fields, not the channels.
+ *           The field layout (plain or self) and offset are resolved at
+ *           compile time, so CHAN_IN1 on a T2T channel is a direct address,
+ *           and CHAN_INn on T2T channels is one lookup in the latest-writer
+ *           index (falling back to n timestamp compares on a miss).
  */
-// #define CHAN_IN1(field, chan0) (&(chan0->data.field.value))
 #define CHAN_IN1(type, field, chan0) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 1, \
-          chan0, offsetof(__typeof__(chan0->data), field))))
+    CHAN_VAR_VALUE(type, CHAN_TRACE_IN(field, \
+          CHAN_VAR_IN(type, field, chan0), chan0))
 #define CHAN_IN2(type, field, chan0, chan1) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 2, \
-          chan0, offsetof(__typeof__(chan0->data), field), \
-          chan1, offsetof(__typeof__(chan1->data), field))))
+    CHAN_VAR_VALUE(type, CHAN_TRACE_IN(field, CHAN_VAR_INDEXED(type, field, 2, \
+          CHAN_SELF_BIT(type, field, chan0, 0) | \
+          CHAN_SELF_BIT(type, field, chan1, 1), \
+          CHAN_VAR_IN(type, field, chan0), \
+          CHAN_VAR_IN(type, field, chan1)), chan0, chan1))
 #define CHAN_IN3(type, field, chan0, chan1, chan2) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 3, \
-          chan0, offsetof(__typeof__(chan0->data), field), \
-          chan1, offsetof(__typeof__(chan1->data), field), \
-          chan2, offsetof(__typeof__(chan2->data), field))))
+    CHAN_VAR_VALUE(type, CHAN_TRACE_IN(field, CHAN_VAR_INDEXED(type, field, 3, \
+          CHAN_SELF_BIT(type, field, chan0, 0) | \
+          CHAN_SELF_BIT(type, field, chan1, 1) | \
+          CHAN_SELF_BIT(type, field, chan2, 2), \
+          CHAN_VAR_IN(type, field, chan0), \
+          CHAN_VAR_IN(type, field, chan1), \
+          CHAN_VAR_IN(type, field, chan2)), chan0, chan1, chan2))
 #define CHAN_IN4(type, field, chan0, chan1, chan2, chan3) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 4, \
-          chan0, offsetof(__typeof__(chan0->data), field), \
-          chan1, offsetof(__typeof__(chan1->data), field), \
-          chan2, offsetof(__typeof__(chan2->data), field), \
-          chan3, offsetof(__typeof__(chan3->data), field))))
+    CHAN_VAR_VALUE(type, CHAN_TRACE_IN(field, CHAN_VAR_INDEXED(type, field, 4, \
+          CHAN_SELF_BIT(type, field, chan0, 0) | \
+          CHAN_SELF_BIT(type, field, chan1, 1) | \
+          CHAN_SELF_BIT(type, field, chan2, 2) | \
+          CHAN_SELF_BIT(type, field, chan3, 3), \
+          CHAN_VAR_IN(type, field, chan0), \
+          CHAN_VAR_IN(type, field, chan1), \
+          CHAN_VAR_IN(type, field, chan2), \
+          CHAN_VAR_IN(type, field, chan3)), chan0, chan1, chan2, chan3))
 #define CHAN_IN5(type, field, chan0, chan1, chan2, chan3, chan4) \
-    ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 5, \
-          chan0, offsetof(__typeof__(chan0->data), field), \
-          chan1, offsetof(__typeof__(chan1->data), field), \
-          chan2, offsetof(__typeof__(chan2->data), field), \
-          chan3, offsetof(__typeof__(chan3->data), field), \
-          chan4, offsetof(__typeof__(chan4->data), field))))
+    CHAN_VAR_VALUE(type, CHAN_TRACE_IN(field, CHAN_VAR_INDEXED(type, field, 5, \
+          CHAN_SELF_BIT(type, field, chan0, 0) | \
+          CHAN_SELF_BIT(type, field, chan1, 1) | \
+          CHAN_SELF_BIT(type, field, chan2, 2) | \
+          CHAN_SELF_BIT(type, field, chan3, 3) | \
+          CHAN_SELF_BIT(type, field, chan4, 4), \
+          CHAN_VAR_IN(type, field, chan0), \
+          CHAN_VAR_IN(type, field, chan1), \
+          CHAN_VAR_IN(type, field, chan2), \
+          CHAN_VAR_IN(type, field, chan3), \
+          CHAN_VAR_IN(type, field, chan4)), chan0, chan1, chan2, chan3, chan4))
 
 /** @brief Write a value into a channel
  *  @details Note: the list of arguments here is a list of
@@ -403,30 +1170,129 @@ void chan_out(const char *field_name, const void *value,
  *  multicast channel would show up as one argument here.
  */
 #define CHAN_OUT1(type, field, val, chan0) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 1, \
-             chan0, offsetof(__typeof__(chan0->data), field))
+    do { \
+        CHAN_FIELD_OUT(type, field, val, chan0); \
+    } while (0)
+#define CHAN_OUT2(type, field, val, chan0, chan1) \
+    do { \
+        CHAN_FIELD_OUT(type, field, val, chan0); \
+        CHAN_FIELD_OUT(type, field, val, chan1); \
+    } while (0)
+#define CHAN_OUT3(type, field, val, chan0, chan1, chan2) \
+    do { \
+        CHAN_FIELD_OUT(type, field, val, chan0); \
+        CHAN_FIELD_OUT(type, field, val, chan1); \
+        CHAN_FIELD_OUT(type, field, val, chan2); \
+    } while (0)
+#define CHAN_OUT4(type, field, val, chan0, chan1, chan2, chan3) \
+    do { \
+        CHAN_FIELD_OUT(type, field, val, chan0); \
+        CHAN_FIELD_OUT(type, field, val, chan1); \
+        CHAN_FIELD_OUT(type, field, val, chan2); \
+        CHAN_FIELD_OUT(type, field, val, chan3); \
+    } while (0)
+#define CHAN_OUT5(type, field, val, chan0, chan1, chan2, chan3, chan4) \
+    do { \
+        CHAN_FIELD_OUT(type, field, val, chan0); \
+        CHAN_FIELD_OUT(type, field, val, chan1); \
+        CHAN_FIELD_OUT(type, field, val, chan2); \
+        CHAN_FIELD_OUT(type, field, val, chan3); \
+        CHAN_FIELD_OUT(type, field, val, chan4); \
+    } while (0)
+
+#else // LIBCHAIN_ENABLE_DIAGNOSTICS
+
+/* With diagnostics, go through chan_in/chan_out which have the field name
+ * and the channel diagnostic info at hand. */
+
+/*
+ *  NOTE: We pass the channel pointer instead of the field pointer
+ *        to have access to diagnostic info. The logic in chain_in
+ *        only strictly needs the fields, not the channels.
+ */
+#define CHAN_IN1(type, field, chan0) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 1, \
+           chan0, offsetof(__typeof__(chan0->data), field)))))
+#define CHAN_IN2(type, field, chan0, chan1) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 2, \
+           chan0, offsetof(__typeof__(chan0->data), field), \
+           chan1, offsetof(__typeof__(chan1->data), field)))))
+#define CHAN_IN3(type, field, chan0, chan1, chan2) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 3, \
+           chan0, offsetof(__typeof__(chan0->data), field), \
+           chan1, offsetof(__typeof__(chan1->data), field), \
+           chan2, offsetof(__typeof__(chan2->data), field)))))
+#define CHAN_IN4(type, field, chan0, chan1, chan2, chan3) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     CHAN_CHECK_TYPE(type, field, chan3), \
+     ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 4, \
+           chan0, offsetof(__typeof__(chan0->data), field), \
+           chan1, offsetof(__typeof__(chan1->data), field), \
+           chan2, offsetof(__typeof__(chan2->data), field), \
+           chan3, offsetof(__typeof__(chan3->data), field)))))
+#define CHAN_IN5(type, field, chan0, chan1, chan2, chan3, chan4) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     CHAN_CHECK_TYPE(type, field, chan3), \
+     CHAN_CHECK_TYPE(type, field, chan4), \
+     ((type*)((unsigned char *)chan_in(#field, sizeof(VAR_TYPE(type)), 5, \
+           chan0, offsetof(__typeof__(chan0->data), field), \
+           chan1, offsetof(__typeof__(chan1->data), field), \
+           chan2, offsetof(__typeof__(chan2->data), field), \
+           chan3, offsetof(__typeof__(chan3->data), field), \
+           chan4, offsetof(__typeof__(chan4->data), field)))))
+
+#define CHAN_OUT1(type, field, val, chan0) \
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     chan_out(#field, &val, sizeof(VAR_TYPE(type)), 1, \
+              chan0, offsetof(__typeof__(chan0->data), field), CHAN_SELF_DIRTY(chan0)))
 #define CHAN_OUT2(type, field, val, chan0, chan1) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 2, \
-             chan0, offsetof(__typeof__(chan0->data), field), \
-             chan1, offsetof(__typeof__(chan1->data), field))
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     chan_out(#field, &val, sizeof(VAR_TYPE(type)), 2, \
+              chan0, offsetof(__typeof__(chan0->data), field), CHAN_SELF_DIRTY(chan0), \
+              chan1, offsetof(__typeof__(chan1->data), field), CHAN_SELF_DIRTY(chan1)))
 #define CHAN_OUT3(type, field, val, chan0, chan1, chan2) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 3, \
-             chan0, offsetof(__typeof__(chan0->data), field), \
-             chan1, offsetof(__typeof__(chan1->data), field), \
-             chan2, offsetof(__typeof__(chan2->data), field))
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     chan_out(#field, &val, sizeof(VAR_TYPE(type)), 3, \
+              chan0, offsetof(__typeof__(chan0->data), field), CHAN_SELF_DIRTY(chan0), \
+              chan1, offsetof(__typeof__(chan1->data), field), CHAN_SELF_DIRTY(chan1), \
+              chan2, offsetof(__typeof__(chan2->data), field), CHAN_SELF_DIRTY(chan2)))
 #define CHAN_OUT4(type, field, val, chan0, chan1, chan2, chan3) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 4, \
-             chan0, offsetof(__typeof__(chan0->data), field), \
-             chan1, offsetof(__typeof__(chan1->data), field), \
-             chan2, offsetof(__typeof__(chan2->data), field), \
-             chan3, offsetof(__typeof__(chan3->data), field))
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     CHAN_CHECK_TYPE(type, field, chan3), \
+     chan_out(#field, &val, sizeof(VAR_TYPE(type)), 4, \
+              chan0, offsetof(__typeof__(chan0->data), field), CHAN_SELF_DIRTY(chan0), \
+              chan1, offsetof(__typeof__(chan1->data), field), CHAN_SELF_DIRTY(chan1), \
+              chan2, offsetof(__typeof__(chan2->data), field), CHAN_SELF_DIRTY(chan2), \
+              chan3, offsetof(__typeof__(chan3->data), field), CHAN_SELF_DIRTY(chan3)))
 #define CHAN_OUT5(type, field, val, chan0, chan1, chan2, chan3, chan4) \
-    chan_out(#field, &val, sizeof(VAR_TYPE(type)), 5, \
-             chan0, offsetof(__typeof__(chan0->data), field), \
-             chan1, offsetof(__typeof__(chan1->data), field), \
-             chan2, offsetof(__typeof__(chan2->data), field), \
-             chan3, offsetof(__typeof__(chan3->data), field), \
-             chan4, offsetof(__typeof__(chan4->data), field))
+    (CHAN_CHECK_TYPE(type, field, chan0), \
+     CHAN_CHECK_TYPE(type, field, chan1), \
+     CHAN_CHECK_TYPE(type, field, chan2), \
+     CHAN_CHECK_TYPE(type, field, chan3), \
+     CHAN_CHECK_TYPE(type, field, chan4), \
+     chan_out(#field, &val, sizeof(VAR_TYPE(type)), 5, \
+              chan0, offsetof(__typeof__(chan0->data), field), CHAN_SELF_DIRTY(chan0), \
+              chan1, offsetof(__typeof__(chan1->data), field), CHAN_SELF_DIRTY(chan1), \
+              chan2, offsetof(__typeof__(chan2->data), field), CHAN_SELF_DIRTY(chan2), \
+              chan3, offsetof(__typeof__(chan3->data), field), CHAN_SELF_DIRTY(chan3), \
+              chan4, offsetof(__typeof__(chan4->data), field), CHAN_SELF_DIRTY(chan4)))
+
+#endif // LIBCHAIN_ENABLE_DIAGNOSTICS
 
 /** @brief Transfer control to the given task
  *  @param task     Name of the task function
@@ -0,0 +1,50 @@
+/** @file Interface for intermittant condition variables
+ *
+ *  Condition variables must be in non-volatile memory (__nv), and are used
+ *  together with a mutex_t. Changes go through the undo log, as for mutexes.
+ */
+
+#ifndef _COND_H
+#define _COND_H
+
+#include "thread.h"
+#include "mutex.h"
+
+typedef struct cond_t {
+    thread_mask_t waiters;  // threads blocked in cond_wait
+} cond_t;
+
+/** @brief Initialize the condition variable pointed to by c
+ *  @param c Condition variable to initialize
+ *  @return 0 on success, a negative integer on error
+ */
+int cond_init(cond_t *c);
+
+/** @brief Release mutex m and wait for c to be signalled
+ *  @param c Condition variable to wait on
+ *  @param m Mutex held by the calling thread
+ *  @return Does not return
+ *
+ *  The current task is discarded and, once the thread is signalled,
+ *  executed again from the start (see thread_block). So, lock m in the same
+ *  task, before checking the condition:
+ *
+ *      mutex_lock(&m);
+ *      if (!ready)
+ *          cond_wait(&c, &m);
+ */
+void cond_wait(cond_t *c, mutex_t *m);
+
+/** @brief Wake up the next thread waiting on c, if any
+ *  @param c Condition variable to signal
+ *  @return Void
+ */
+void cond_signal(cond_t *c);
+
+/** @brief Wake up all threads waiting on c
+ *  @param c Condition variable to signal
+ *  @return Void
+ */
+void cond_broadcast(cond_t *c);
+
+#endif
@@ -0,0 +1,112 @@
+/** @file host.h
+ *  @brief Host (x86-64 Linux) port of the runtime
+ *
+ *  Built with LIBCHAIN_HOST defined (see bld/host). Non-volatile variables
+ *  are collected into one page-aligned section that can be backed by an
+ *  mmap'ed file, task transitions reset the stack with longjmp, and power
+ *  failures are emulated by jumping back to the boot path at configurable
+ *  points. Volatile (non-__nv) variables keep their values across an
+ *  emulated reboot, so the application init() should re-initialize them,
+ *  exactly as it would have to do on the device.
+ */
+
+#ifndef LIBCHAIN_HOST_H
+#define LIBCHAIN_HOST_H
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Place a variable into emulated FRAM */
+#define __nv __attribute__((section(".nv_vars")))
+
+/** @brief The ELF C runtime already defines _init, rename the boot hook */
+#define _init _chain_init
+
+/** @brief Points in the runtime at which a power failure can be injected */
+typedef enum {
+    HOST_POINT_TRANSITION,  // in transition_to, before the context flip
+    HOST_POINT_CHAN_OUT,    // in chan_out, after the value has been written
+    HOST_POINT_NV_WRITE,    // in task_nv_write, between the log and the write
+    HOST_POINT_BLOCK,       // in thread_block_on, after the rollback
+} host_point_t;
+
+/** @brief Run configuration, read from the environment in host_init()
+ *  @details All fields may also be set programmatically from init().
+ *
+ *    CHAIN_NV_FILE           back __nv memory by this file (default: none)
+ *    CHAIN_RESET_EVERY       reboot on every Nth transition
+ *    CHAIN_RESET_RANDOM      reboot with probability 1/N at every injection point
+ *    CHAIN_RESET_AT_CHAN_OUT reboot once, on the Nth chan_out
+ *    CHAIN_RESET_SEED        seed for CHAIN_RESET_RANDOM
+ *    CHAIN_MAX_TRANSITIONS   end the run (and print the report) after N transitions
+ */
+typedef struct {
+    unsigned long reset_every;
+    unsigned long reset_random;
+    unsigned long reset_at_chan_out;
+    unsigned long max_transitions;
+    unsigned long seed;
+} host_config_t;
+
+/** @brief Counters collected by the host runtime (in volatile memory) */
+typedef struct {
+    unsigned long transitions;
+    unsigned long reboots;      // injected, not counting the first boot
+    unsigned long chan_outs;
+    unsigned long nv_writes;
+    uint64_t start_ns;
+    uint64_t wasted_ns;         // time spent in executions cut by a reboot
+    uint64_t task_ns[32];       // time spent in each task, by task index
+    unsigned long task_runs[32];
+} host_stats_t;
+
+extern host_config_t host_config;
+extern host_stats_t host_stats;
+
+#define HOST_JMP_TASK   1
+#define HOST_JMP_REBOOT 2
+
+/** @brief Target of task transitions and emulated reboots, set up in main */
+extern jmp_buf host_env;
+
+/** @brief Map non-volatile memory and read the configuration (first boot only) */
+void host_init();
+
+/** @brief Start executing the given task function on a fresh stack */
+void host_run_task(void (*func)(void)) __attribute__((noreturn));
+
+/** @brief Called from main on HOST_JMP_TASK: run the pending task function */
+void host_enter_task() __attribute__((noreturn));
+
+/** @brief Injection point: counts the event and reboots if configured to */
+void host_point(host_point_t point);
+
+/** @brief The runtime cannot go on (see ARCH_HALT): report the cause and
+ *         end the run with a failure status
+ */
+void host_halt(const char *cause) __attribute__((noreturn));
+
+/** @brief Every thread has ended (see ARCH_END): end the run successfully */
+void host_end() __attribute__((noreturn));
+
+/** @brief Emulate a power failure: reboot now */
+void host_reboot() __attribute__((noreturn));
+
+/** @brief Monotonic wall-clock time in nanoseconds */
+uint64_t host_time_ns();
+
+/** @brief Copy the non-volatile memory, to compare against later */
+void host_nv_snapshot();
+
+/** @brief Number of bytes of non-volatile memory that differ from the copy
+ *         made by the last host_nv_snapshot
+ *  @details A lower bound of the bytes written since then: writes of the
+ *           value a byte already had, and repeated writes, are not seen.
+ */
+size_t host_nv_changed();
+
+/** @brief Print the counters collected so far */
+void host_report(FILE *out);
+
+#endif // LIBCHAIN_HOST_H
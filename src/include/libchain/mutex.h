@@ -1,12 +1,28 @@
 /** @file Interface for intermittant mutexes
+ *
+ *  Mutexes must be in non-volatile memory (__nv). All changes to a mutex
+ *  go through the undo log (task_nv_write), so they take effect when the
+ *  task that makes them transitions, and not at all if it is restarted.
  */
 
 #ifndef _MUTEX_H
 #define _MUTEX_H
 
+#include "thread.h"
+
+/** @brief Holder of a mutex that is not held */
+#define MUTEX_NO_HOLDER (MAX_NUM_THREADS + 1)
+
 typedef struct mutex_t {
     unsigned free;
     unsigned holder; 
+    thread_mask_t waiters;  // threads blocked in mutex_lock
+#ifdef LIBCHAIN_STATS
+    stat_count_t contention; // times a thread blocked in mutex_lock
+#endif
+#ifdef LIBCHAIN_TRACE
+    unsigned trace_id;      // of its events, see trace_mutex_id
+#endif
 } mutex_t;
 
 /** @brief Initialize the mutex pointed to by m
@@ -17,16 +33,22 @@ int mutex_init(mutex_t *m);
 
 /** @brief Attempt to lock mutex m
  *  @param m Mutex to lock
- *  @param id thread id of holder
  *  @return Void
  *
- *  If the mutex cannot be locked, deschedule the calling thread
+ *  If the mutex is held by another thread, the calling thread blocks until
+ *  the mutex is handed over to it by mutex_unlock. Like thread_block, the
+ *  current task is then executed again from the start, and this time
+ *  mutex_lock returns with the lock held. Whatever the task did before
+ *  blocking is discarded, and done again in that execution.
  */
 void mutex_lock(mutex_t *m);
 
 /** @brief Unlock mutex m
  *  @param m Mutex to unlock
  *  @return Void
+ *
+ *  If threads are waiting, the next one in round-robin order after the
+ *  holder becomes the holder, and is woken up.
  */
 void mutex_unlock(mutex_t *m);
 
@@ -0,0 +1,122 @@
+/** @file Interface for queue channels: bounded FIFOs between tasks
+ *
+ *  Unlike the other channel types, where the last written value wins, a
+ *  queue channel keeps every value until it is read. Queues are declared
+ *  like channels and referred to with CH(src, dest):
+ *
+ *      QUEUE_CHANNEL(task_sample, task_filter, unsigned, 8);
+ *
+ *      QUEUE_OUT(unsigned, sample, CH(task_sample, task_filter));
+ *      QUEUE_IN(unsigned, sample, CH(task_sample, task_filter));
+ *
+ *  The head and tail indices are written through the undo log, so an
+ *  enqueue or dequeue takes effect when its task transitions, and not at
+ *  all if the task is restarted. A value is stored in its slot before the
+ *  tail moves past it, so a half-written slot is never read.
+ *
+ *  Enqueueing into a full queue, or dequeueing from an empty one, blocks
+ *  the calling thread until the other side makes progress, and the task is
+ *  then executed again from the start (see thread_block). Single-threaded
+ *  applications use the QUEUE_TRY_ variants.
+ */
+
+#ifndef _QUEUE_H
+#define _QUEUE_H
+
+#include "chain.h"
+#include "thread.h"
+
+typedef struct queue_t {
+    unsigned head;              // number of values dequeued so far
+    unsigned tail;              // number of values enqueued so far
+    unsigned capacity;          // a power of two
+    unsigned elem_size;
+    thread_mask_t readers;      // threads blocked on an empty queue
+    thread_mask_t writers;      // threads blocked on a full queue
+} queue_t;
+
+/** @brief Declare a queue channel
+ *  @param src      Name of the source task
+ *  @param dest     Name of the destination task
+ *  @param type     Type of the values
+ *  @param capacity Max number of values in the queue, a power of two
+ */
+#define QUEUE_CHANNEL(src, dest, type, capacity) \
+    _Static_assert(((capacity) & ((capacity) - 1)) == 0 && (capacity) > 0, \
+                   "queue capacity must be a power of two"); \
+    __nv struct _ch_queue_ ## src ## _ ## dest { \
+        chan_meta_t meta; \
+        queue_t queue; \
+        type buf[capacity]; \
+    } _ch_ ## src ## _ ## dest = \
+        { { CHAN_TYPE_QUEUE, { #src, #dest } }, \
+          { 0, 0, (capacity), sizeof(type), 0, 0 } }
+
+/** @brief Compile-time check that values of the type fit the slots of the
+ *         queue, as an expression
+ */
+#define QUEUE_CHECK_TYPE(type, chan) \
+    ((void)sizeof(struct { \
+        _Static_assert(sizeof(type) == sizeof((chan)->buf[0]), \
+                       "type does not match the values of the queue"); \
+        char unused; \
+    }))
+
+/** @brief Append a value, blocking while the queue is full */
+#define QUEUE_OUT(type, val, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_out(&(chan)->queue, (chan)->buf, &(val), 1))
+
+/** @brief Remove the oldest value into var, blocking while the queue is empty */
+#define QUEUE_IN(type, var, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_in(&(chan)->queue, (chan)->buf, &(var), 1))
+
+/** @brief Append count values from the array vals, blocking until all fit */
+#define QUEUE_OUT_N(type, vals, count, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_out(&(chan)->queue, (chan)->buf, (vals), (count)))
+
+/** @brief Remove the count oldest values into the array vars, blocking until
+ *         there are that many */
+#define QUEUE_IN_N(type, vars, count, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_in(&(chan)->queue, (chan)->buf, (vars), (count)))
+
+/** @brief Non-blocking variants: return 0 on success, -1 if the queue is
+ *         full (empty) */
+#define QUEUE_TRY_OUT(type, val, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_try_out(&(chan)->queue, (chan)->buf, &(val), 1))
+#define QUEUE_TRY_IN(type, var, chan) \
+    (QUEUE_CHECK_TYPE(type, chan), \
+     queue_try_in(&(chan)->queue, (chan)->buf, &(var), 1))
+
+/** @brief Number of values in the queue */
+#define QUEUE_COUNT(chan) ((chan)->queue.tail - (chan)->queue.head)
+
+/** @brief Append count values, blocking until there is room for all
+ *  @param q     Queue of the channel
+ *  @param buf   Value storage of the channel
+ *  @param vals  Values to append
+ *  @param count Number of values, at most the capacity: more could never
+ *               fit, and halt instead of blocking forever
+ */
+void queue_out(queue_t *q, void *buf, const void *vals, unsigned count);
+
+/** @brief Remove the count oldest values, blocking until there are that many
+ *  @param q     Queue of the channel
+ *  @param buf   Value storage of the channel
+ *  @param vars  Where to copy the values to
+ *  @param count Number of values, at most the capacity: more could never
+ *               be there, and halt instead of blocking forever
+ */
+void queue_in(queue_t *q, void *buf, void *vars, unsigned count);
+
+/** @brief As queue_out, but returns -1 instead of blocking, 0 on success */
+int queue_try_out(queue_t *q, void *buf, const void *vals, unsigned count);
+
+/** @brief As queue_in, but returns -1 instead of blocking, 0 on success */
+int queue_try_in(queue_t *q, void *buf, void *vars, unsigned count);
+
+#endif
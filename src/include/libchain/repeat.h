@@ -19,5 +19,24 @@
 #define REPEAT_INNER(count, x) REPEAT ## count(x)
 #define REPEAT(count, x) REPEAT_INNER(count, x)
 
+/** @brief Expand m(ctx, x) for each x of up to 8 arguments
+ *  @details The expansions are concatenated, so m supplies any separator.
+ */
+#define FOR_EACH1(m, ctx, x)      m(ctx, x)
+#define FOR_EACH2(m, ctx, x, ...) m(ctx, x) FOR_EACH1(m, ctx, __VA_ARGS__)
+#define FOR_EACH3(m, ctx, x, ...) m(ctx, x) FOR_EACH2(m, ctx, __VA_ARGS__)
+#define FOR_EACH4(m, ctx, x, ...) m(ctx, x) FOR_EACH3(m, ctx, __VA_ARGS__)
+#define FOR_EACH5(m, ctx, x, ...) m(ctx, x) FOR_EACH4(m, ctx, __VA_ARGS__)
+#define FOR_EACH6(m, ctx, x, ...) m(ctx, x) FOR_EACH5(m, ctx, __VA_ARGS__)
+#define FOR_EACH7(m, ctx, x, ...) m(ctx, x) FOR_EACH6(m, ctx, __VA_ARGS__)
+#define FOR_EACH8(m, ctx, x, ...) m(ctx, x) FOR_EACH7(m, ctx, __VA_ARGS__)
+
+#define FOR_EACH_COUNT(_1, _2, _3, _4, _5, _6, _7, _8, count, ...) count
+#define FOR_EACH_INNER(count, m, ctx, ...) FOR_EACH ## count(m, ctx, __VA_ARGS__)
+#define FOR_EACH_N(count, m, ctx, ...) FOR_EACH_INNER(count, m, ctx, __VA_ARGS__)
+#define FOR_EACH(m, ctx, ...) \
+    FOR_EACH_N(FOR_EACH_COUNT(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0), \
+               m, ctx, __VA_ARGS__)
+
 #endif // LIBCHAIN_REPEAT_H
 
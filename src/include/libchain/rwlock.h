@@ -0,0 +1,59 @@
+/** @file Interface for intermittant reader-writer locks
+ *
+ *  Any number of threads may hold the lock for reading, or one thread for
+ *  writing. Writers are preferred: once a writer waits, new readers wait
+ *  behind it. Locks must be in non-volatile memory (__nv), and as for
+ *  mutexes, all changes go through the undo log. The holders are kept as
+ *  sets of thread slots, so a lock held across tasks, or across a power
+ *  failure, still has the same holders afterwards.
+ */
+
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include "thread.h"
+
+/** @brief Writer of a lock that is not write-locked */
+#define RWLOCK_NO_WRITER (MAX_NUM_THREADS + 1)
+
+typedef struct rwlock_t {
+    thread_mask_t readers;          // threads holding the lock for reading
+    unsigned writer;                // thread holding it for writing
+    thread_mask_t read_waiters;     // threads blocked in rwlock_rdlock
+    thread_mask_t write_waiters;    // threads blocked in rwlock_wrlock
+} rwlock_t;
+
+/** @brief Initialize the lock pointed to by l
+ *  @param l Lock to initialize
+ *  @return 0 on success, a negative integer on error
+ */
+int rwlock_init(rwlock_t *l);
+
+/** @brief Lock l for reading
+ *  @param l Lock to take
+ *  @return Void
+ *
+ *  Blocks while a writer holds or waits for the lock. As with mutex_lock,
+ *  the current task is then executed again from the start, and this time
+ *  rwlock_rdlock returns with the lock held.
+ */
+void rwlock_rdlock(rwlock_t *l);
+
+/** @brief Lock l for writing
+ *  @param l Lock to take
+ *  @return Void
+ *
+ *  Blocks while any other thread holds the lock, see rwlock_rdlock.
+ */
+void rwlock_wrlock(rwlock_t *l);
+
+/** @brief Release the hold of the calling thread on l
+ *  @param l Lock to release
+ *  @return Void
+ *
+ *  When the lock becomes free, it is handed to the next waiting writer in
+ *  round-robin order, or else to all waiting readers at once.
+ */
+void rwlock_unlock(rwlock_t *l);
+
+#endif
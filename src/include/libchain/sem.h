@@ -0,0 +1,45 @@
+/** @file Interface for intermittant counting semaphores
+ *
+ *  Semaphores must be in non-volatile memory (__nv). As for mutexes, all
+ *  changes go through the undo log, so they take effect when the task that
+ *  makes them transitions, and not at all if it is restarted.
+ */
+
+#ifndef _SEM_H
+#define _SEM_H
+
+#include "thread.h"
+
+typedef struct semaphore_t {
+    unsigned count;
+    thread_mask_t waiters;  // threads blocked in semaphore_wait
+    thread_mask_t granted;  // woken waiters, each owed one unit
+} semaphore_t;
+
+/** @brief Initialize the semaphore pointed to by s
+ *  @param s Semaphore to initialize
+ *  @param count Initial number of available units
+ *  @return 0 on success, a negative integer on error
+ */
+int semaphore_init(semaphore_t *s, unsigned count);
+
+/** @brief Take one unit of semaphore s
+ *  @param s Semaphore to take from
+ *  @return Void
+ *
+ *  If no unit is available, the calling thread blocks until semaphore_post
+ *  passes one to it. The current task is then executed again from the
+ *  start (see thread_block), and this time semaphore_wait returns.
+ */
+void semaphore_wait(semaphore_t *s);
+
+/** @brief Give one unit back to semaphore s
+ *  @param s Semaphore to give to
+ *  @return Void
+ *
+ *  If threads are waiting, the unit goes directly to the next one in
+ *  round-robin order, which is woken up.
+ */
+void semaphore_post(semaphore_t *s);
+
+#endif
@@ -0,0 +1,68 @@
+/** @file stats.h
+ *  @brief Runtime statistics, with LIBCHAIN_STATS
+ *
+ *  Counters of where the work goes: per task, per thread and per mutex. They
+ *  are kept in non-volatile memory, so they add up across reboots, and are
+ *  written with plain writes, so work that a reboot makes a task do again is
+ *  counted again, as it costs energy again. The application reads them with
+ *  the functions below, or prints them all with stats_dump, e.g. from a
+ *  task that runs every so often.
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+
+/** @brief Max number of mutexes listed by stats_dump */
+#ifndef STATS_MAX_MUTEXES
+#define STATS_MAX_MUTEXES 8
+#endif
+
+/** @brief Counters of a thread slot */
+typedef struct {
+    stat_count_t switches;      // times the slot was switched to
+    stat_count_t blocked_time;  // blocked or waiting for a release, in
+                                // thread_clock units, until it ran again
+} thread_stats_t;
+
+/** @brief Counters of the given task */
+#define TASK_STATS(task) stats_task(TASK_REF(task))
+
+const task_stats_t *stats_task(const task_t *task);
+
+/** @brief Counters of the thread slot id */
+const thread_stats_t *stats_thread(unsigned id);
+
+/** @brief Number of times a thread blocked on mutex m */
+stat_count_t stats_mutex_contention(const mutex_t *m);
+
+/** @brief Number of boots, the first one included */
+unsigned stats_boots();
+
+/** @brief Print all counters, one line per task (that has run), thread and
+ *         mutex (that was initialized)
+ */
+void stats_dump();
+
+/** @brief Clear all counters
+ *  @details Plain writes: if the calling task is restarted, it clears them
+ *           again.
+ */
+void stats_reset();
+
+/** @brief Internal: account the start of a task execution (task_prologue) */
+void stats_prologue(task_t *task, int restarted);
+
+/** @brief Internal: the running thread blocks, or waits for its release
+ *  @details Written through the undo log: if the task is restarted before
+ *           the switch commits it, the thread has not blocked.
+ */
+void stats_blocked(unsigned id);
+
+/** @brief Internal: list a mutex for stats_dump (mutex_init) */
+void stats_mutex_init(mutex_t *m);
+
+#endif
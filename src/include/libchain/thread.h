@@ -6,25 +6,114 @@
 #ifndef _THREAD_H
 #define _THREAD_H
 
+#include <limits.h>
+
 #include "chain.h"
 
 #define MAX_NUM_THREADS 4
 
+/** @brief Identifier of a thread, as returned by thread_create
+ *  @details The slot of the thread is in the low THREAD_ID_SLOT_BITS bits,
+ *           the generation of the slot above them. The generation changes
+ *           with every thread created in the slot, so that thread_join
+ *           tells the thread from a later one in the same slot; it wraps
+ *           around after THREAD_ID_GEN_MASK + 1 creations. The functions
+ *           and macros that take a slot also take an identifier.
+ */
+#define THREAD_ID_SLOT_BITS 5
+#define THREAD_ID_SLOT(id) ((unsigned)(id) & ((1U << THREAD_ID_SLOT_BITS) - 1))
+#define THREAD_ID_GEN(id) ((unsigned)(id) >> THREAD_ID_SLOT_BITS)
+#define THREAD_ID_GEN_MASK (INT_MAX >> THREAD_ID_SLOT_BITS)
+#define THREAD_ID(slot, gen) ((int)((gen) << THREAD_ID_SLOT_BITS | (slot)))
+
+/** @brief Default number of consecutive TRANSITION_TO_MT boundaries a thread
+ *         runs before the scheduler switches to another thread
+ *  @details 1 switches at every boundary. Larger values trade fairness for
+ *           fewer thread switches; see also thread_set_quantum.
+ */
+#ifndef THREAD_QUANTUM
+#define THREAD_QUANTUM 1
+#endif
+
+/** @brief Set of threads, bit i for the thread in slot i */
+typedef unsigned thread_mask_t;
+
+#define THREAD_MASK(id) ((thread_mask_t)1 << (id))
+
+/** @brief Priority of threads created with thread_create
+ *  @details Priorities are only used when the runtime is built with
+ *           LIBCHAIN_SCHED_PRIO: then the scheduler picks the ready thread
+ *           with the highest effective priority, which is its priority plus
+ *           one for every THREAD_AGING task boundaries it has been waiting,
+ *           up to THREAD_AGING_MAX. Ties, and all decisions without
+ *           LIBCHAIN_SCHED_PRIO, go round robin.
+ */
+#ifndef THREAD_PRIO_DEFAULT
+#define THREAD_PRIO_DEFAULT 0
+#endif
+
+#ifndef THREAD_AGING
+#define THREAD_AGING 16
+#endif
+
+#ifndef THREAD_AGING_MAX
+#define THREAD_AGING_MAX 64
+#endif
+
+/** @brief Time of the scheduler clock, see thread_clock
+ *  @details Clock values wrap around: periods and deadlines must be below
+ *           half the range of the type.
+ */
+typedef unsigned sched_time_t;
+
 #define TRANSITION_TO_MT(task) transition_to_mt(TASK_REF(task))
 
-typedef struct thread_t {
-    // TODO - overflow is possible!
-    unsigned thread_id;
-    context_t context;
-} thread_t;
+/** @brief Declare a channel with one instance per thread slot
+ *  @details For task code that runs in several threads at once: each
+ *           thread passes values between src and dest through its own
+ *           instance, picked with CH_THIS. Scales with MAX_NUM_THREADS, so
+ *           unlike CHANNEL_WT, nothing needs to be declared per thread.
+ */
+#define THREAD_CHANNEL(src, dest, type) \
+    __nv CH_TYPE(src, dest, type) _ch_th_ ## src ## _ ## dest[MAX_NUM_THREADS] = \
+        { [0 ... MAX_NUM_THREADS - 1] = { { CHAN_TYPE_T2T, { #src, #dest } } } }; \
+    TIME_REGION(_ch_th_ ## src ## _ ## dest, _ch_th_ ## src ## _ ## dest)
+
+/** @brief Declare a self channel with one instance per thread slot */
+#define THREAD_SELF_CHANNEL(task, type) \
+    __nv SELF_CH_TYPE(task, task, type) _ch_th_ ## task ## _ ## task[MAX_NUM_THREADS] = \
+        { [0 ... MAX_NUM_THREADS - 1] = \
+            { { CHAN_TYPE_SELF, { #task, #task } }, SELF_FIELDS_INITIALIZER(type), \
+              SELF_CHAN_DIRTY_INITIALIZER(type) } }; \
+    TIME_REGION(_ch_th_ ## task ## _ ## task, _ch_th_ ## task ## _ ## task)
+
+/** @brief Instance of a THREAD_CHANNEL of the running thread */
+#define CH_THIS(src, dest) (&_ch_th_ ## src ## _ ## dest[curctx->thread])
 
-__nv extern thread_t * volatile cur_thread;
+/** @brief Instance of a THREAD_CHANNEL of the thread in slot id, e.g. for a
+ *         task that hands work to a given thread */
+#define CH_THREAD(src, dest, id) (&_ch_th_ ## src ## _ ## dest[THREAD_ID_SLOT(id)])
 
-//extern SELF_CHANNEL_DEC(scheduler_task,thread_array);
-//extern struct _ch_type_scheduler_task_scheduler_task_thread_array
-//							_ch_scheduler_task_scheduler_task;
+/** @brief Pair of contexts of each thread slot, see transition_to_thread */
+extern context_t thread_contexts[MAX_NUM_THREADS][2];
+
+/** @brief Context in which a thread continues, while it is switched out
+ *  @details Its task is the continuation of the thread, and its time the
+ *           time of the task that switched the thread out.
+ */
+extern context_t * volatile thread_resume_ctx[MAX_NUM_THREADS];
+
+/** @brief Set up the contexts of a thread slot, for a new thread that
+ *         starts at the given task
+ *  @details Plain writes: the slot must not be in use.
+ */
+void thread_context_init(unsigned thread, task_t *task);
 
 #define THREAD_CREATE(task) thread_create(TASK_REF(task))
+#define THREAD_CREATE_PRIO(task, prio) thread_create_prio(TASK_REF(task), prio)
+#define THREAD_CREATE_PERIODIC(task, period, deadline) \
+    thread_create_periodic(TASK_REF(task), period, deadline)
+#define THREAD_WAIT_PERIOD(task) thread_wait_period(TASK_REF(task))
 
 //For consistency in macro-omnipresence
 #define THREAD_END() thread_end()
@@ -39,23 +128,153 @@ void thread_end();
 
 /** @brief Creates a separate thread to run task new_task
  *  @param new_task Task entry point for the thread
- *  @return 0 on success, a negative error code on failure
+ *  @return Identifier of the new thread (see THREAD_ID_SLOT) on success,
+ *          a negative error code on failure
  */
 int thread_create(task_t *new_task);
 
-/** @brief Gets the currently running thread
- *  @return Pointer to the struct describing the current thread
+/** @brief Creates a separate thread with the given priority
+ *  @param new_task Task entry point for the thread
+ *  @param prio Priority of the thread, higher runs first
+ *  @return Identifier of the new thread (see THREAD_ID_SLOT) on success,
+ *          a negative error code on failure
+ */
+int thread_create_prio(task_t *new_task, unsigned prio);
+
+/** @brief Creates a thread that runs one job every period
+ *  @param new_task Task entry point for the thread
+ *  @param period Time between job releases, in thread_clock units
+ *  @param deadline Time after the release by which a job must be done
+ *  @return Identifier of the new thread (see THREAD_ID_SLOT) on success,
+ *          a negative error code on failure
+ *
+ *  The first job is released at creation. A job ends with
+ *  THREAD_WAIT_PERIOD, and one that ends after its deadline is counted as
+ *  a miss (see thread_misses). With LIBCHAIN_SCHED_EDF, the scheduler runs
+ *  the ready job with the earliest deadline first, and threads that are
+ *  not periodic only when no job is ready.
  */
-thread_t get_current_thread();
+int thread_create_periodic(task_t *new_task, sched_time_t period,
+                           sched_time_t deadline);
 
-/** @brief Deschedules the running thread
+/** @brief Ends the job of the running periodic thread
+ *  @param next_task Task at which the next job starts
+ *  @return Void
+ *
+ *  The thread waits until the release of its next job, unless that is
+ *  already due. For a thread that is not periodic, this is TRANSITION_TO_MT.
+ */
+void thread_wait_period(task_t *next_task);
+
+/** @brief Number of jobs of a periodic thread that missed their deadline
+ *  @param id Slot or identifier of the thread
+ */
+unsigned thread_misses(unsigned id);
+
+/** @brief Time source for periodic threads
+ *  @details The library has a weak default (microseconds on the host,
+ *           logical time on the device), which the application overrides
+ *           by defining this function, e.g. to read a timer that keeps
+ *           running across power failures. The default device clock only
+ *           advances with task transitions, and with the default
+ *           thread_idle, which skips it ahead when every thread waits.
+ */
+sched_time_t thread_clock();
+
+/** @brief Called by the scheduler while every live thread waits for the
+ *         release of its next job
+ *  @param until Earliest release, in thread_clock units
+ *  @details Called again until thread_clock reaches the release. The weak
+ *           default returns right away, except that on the device it moves
+ *           the default clock to the release, as logical time cannot pass
+ *           otherwise. An application with its own clock can override it,
+ *           e.g. to sleep until a timer interrupt.
+ */
+void thread_idle(sched_time_t until);
+
+/** @brief Waits until a thread has ended
+ *  @param id Identifier of the thread, as returned by thread_create
+ *  @return Void
+ *
+ *  If the thread is still running, the calling thread blocks, and like
+ *  with thread_block, the current task is executed again from the start
+ *  when the thread ends. Returns right away if the thread has ended, also
+ *  when its slot holds a later thread by now.
+ *
+ *  The thread must have been created by an earlier task: blocking rolls the
+ *  current task back, creations included, so joining a thread created in
+ *  the same task execution halts. Create the threads in one task and join
+ *  them in the next, e.g. with TRANSITION_TO in between.
+ */
+void thread_join(unsigned id);
+
+/** @brief Gets the index of the currently running thread in the thread array
+ */
+unsigned get_current();
+
+/** @brief Deschedules the running thread, even if its quantum is not used up
  *  @return Void
  */
 void deschedule();
 
-void transition_to_mt(task_t *next_task);
+/** @brief Removes the running thread from scheduling until thread_wake
+ *  @return Void
+ *
+ *  The current task is executed again from the start when the thread is
+ *  woken up, so that it can re-check the condition it blocked on. What the
+ *  task did before blocking is discarded (see task_rollback).
+ */
+void thread_block();
+
+/** @brief Adds the running thread to a set of waiters and blocks it
+ *  @param waiters Set of waiting threads of a synchronization object
+ *  @return Void
+ *
+ *  As thread_block. The waker removes the thread from the set and calls
+ *  thread_wake. The set is written after the rollback, so that it is not
+ *  undone with the rest of the task.
+ */
+void thread_block_on(volatile thread_mask_t *waiters);
 
-/** @brief returns a pointer to the current thread */
-uint8_t getThreadPtr();
+/** @brief Adds the running thread to a set of waiters and blocks it, keeping
+ *         what the task did so far
+ *  @param waiters Set of waiting threads of a synchronization object
+ *  @return Void
+ *
+ *  For synchronization objects that roll the task back themselves and then
+ *  change some state that must survive the block (see cond_wait).
+ */
+void thread_suspend_on(volatile thread_mask_t *waiters);
+
+/** @brief First thread of a non-empty set after slot 'after', round robin
+ *  @param set Set of threads, must not be empty
+ *  @param after Slot to start after
+ *  @return Slot of the thread
+ */
+unsigned thread_mask_next(thread_mask_t set, unsigned after);
+
+/** @brief Makes a blocked thread schedulable again
+ *  @param id Slot of the thread in the thread array
+ *  @return Void
+ */
+void thread_wake(unsigned id);
+
+/** @brief Makes a set of blocked threads schedulable again
+ *  @param set Slots of the threads
+ *  @return Void
+ */
+void thread_wake_set(thread_mask_t set);
+
+/** @brief Sets the scheduling quantum of a thread
+ *  @param id Slot or identifier of the thread
+ *  @param quantum Boundaries per turn, 0 for the default (THREAD_QUANTUM)
+ *  @return Void
+ *
+ *  Takes effect when the task that calls it transitions. The quantum of a
+ *  slot is reset to the default when a new thread is created in it.
+ */
+void thread_set_quantum(unsigned id, unsigned quantum);
+
+void transition_to_mt(task_t *next_task);
 
 #endif
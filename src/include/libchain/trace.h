@@ -0,0 +1,152 @@
+/** @file trace.h
+ *  @brief Binary event trace, with LIBCHAIN_TRACE
+ *
+ *  The runtime records what it does into a ring buffer in non-volatile
+ *  memory, four bytes per event: the event type, the thread slot, one
+ *  argument (an index, not a name) and the low bits of the logical time.
+ *  Writes are plain, so the trace also shows the work that a reboot cut
+ *  short. The buffer starts with a header that describes its layout, and
+ *  holds the addresses of the traced tasks, mutexes and channels, so that
+ *  a host tool (tools/trace_decode.c) can find it in a dump of the
+ *  non-volatile memory (or a CHAIN_NV_FILE on the host) and print a
+ *  timeline per thread, with task and channel names read from the dump.
+ *
+ *  This header only describes the format, and is included by the decoder
+ *  without the rest of the runtime.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/** @brief Number of events in the ring, a power of two */
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 256
+#endif
+
+/** @brief Number of mutexes that get an id of their own, see
+ *         trace_mutex_id */
+#ifndef TRACE_MAX_MUTEXES
+#define TRACE_MAX_MUTEXES 8
+#endif
+
+/** @brief Number of channel fields that get an id of their own, a power of
+ *         two, see trace_field */
+#ifndef TRACE_MAX_FIELDS
+#define TRACE_MAX_FIELDS 32
+#endif
+
+/** @brief Number of slots of the field table that a field can take,
+ *         starting from the one its hash picks */
+#ifndef TRACE_FIELD_PROBES
+#define TRACE_FIELD_PROBES 4
+#endif
+
+/** @brief Argument of an event on a mutex or a field that got no id */
+#define TRACE_ID_NONE 0xff
+
+/** @brief Number of task indices (see TASK) */
+#define TRACE_MAX_TASKS 32
+
+#define TRACE_MAGIC   0x43525448UL // "HTRC"
+#define TRACE_VERSION 3
+
+/** @brief Event types
+ *  @details The argument of each event is given in parentheses.
+ */
+typedef enum {
+    TRACE_NONE = 0,
+    TRACE_BOOT,         // the device booted (boot count, low 8 bits)
+    TRACE_TASK_START,   // a task started after a transition (task index)
+    TRACE_TASK_RESTART, // a task started again after a reboot (task index)
+    TRACE_SCHED,        // the scheduler picked a thread (its slot)
+    TRACE_CHAN_IN,      // a field was read (field id)
+    TRACE_CHAN_OUT,     // a field was written (field id)
+    TRACE_MUTEX_LOCK,   // a mutex was taken (mutex id)
+    TRACE_MUTEX_WAIT,   // the thread blocked on a mutex (mutex id)
+    TRACE_MUTEX_UNLOCK, // a mutex was released (mutex id)
+    TRACE_NUM_TYPES,
+} trace_type_t;
+
+/** @brief One event */
+typedef struct {
+    uint8_t info;   // type in the high four bits, thread slot in the low ones
+    uint8_t arg;
+    uint16_t time;  // low bits of the logical time of the task execution
+} trace_event_t;
+
+#define TRACE_INFO(type, thread) ((uint8_t)(((type) << 4) | ((thread) & 0xf)))
+#define TRACE_INFO_TYPE(info)    ((info) >> 4)
+#define TRACE_INFO_THREAD(info)  ((info) & 0xf)
+
+/** @brief Header of the trace buffer
+ *  @details Laid out without padding on both the device and the host. The
+ *           buffer continues with TRACE_MAX_TASKS task addresses,
+ *           max_mutexes mutex addresses, max_fields channel addresses
+ *           (each ptr_size bytes, 0 where unused), max_fields field offsets
+ *           (two bytes each) and size events.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;          // of the ring, in events
+    volatile uint16_t head; // next event to write
+    volatile uint16_t wrapped; // nonzero once the ring is full
+    uint8_t ptr_size;
+    uint8_t name_offset;    // of the name in a task_t
+    uint8_t name_size;
+    uint8_t max_mutexes;
+    uint8_t max_fields;
+    uint8_t chan_name_offset; // of the source name in a channel
+    uint8_t chan_name_size;   // the dest name follows the source name
+    volatile uint8_t full;    // TRACE_FULL_* of the tables that ran out
+    uint8_t reserved[4];
+    uint64_t self;          // address of the header, to resolve the others
+} trace_header_t;
+
+#define TRACE_FULL_MUTEXES 0x1
+#define TRACE_FULL_FIELDS  0x2
+
+typedef struct {
+    trace_header_t hdr;
+    uintptr_t tasks[TRACE_MAX_TASKS];
+    uintptr_t mutexes[TRACE_MAX_MUTEXES];
+    uintptr_t fields[TRACE_MAX_FIELDS];          // channel of each field
+    uint16_t field_offsets[TRACE_MAX_FIELDS];    // in the data of the channel
+    trace_event_t events[TRACE_SIZE];
+} trace_buf_t;
+
+/** @brief Record an event of the running thread */
+void trace_event(unsigned type, unsigned arg);
+
+/** @brief Record the start of a task execution, see TRACE_TASK_START */
+void trace_task(unsigned type, const void *task, unsigned idx);
+
+/** @brief Id of a mutex in the trace, for its events (mutex_init)
+ *  @details Looks the mutex up in the table of the trace, or adds it. A
+ *           mutex beyond TRACE_MAX_MUTEXES gets TRACE_ID_NONE, and sets
+ *           TRACE_FULL_MUTEXES in the header.
+ */
+unsigned trace_mutex_id(const void *mutex);
+
+/** @brief Record an event on a field of a channel
+ *  @param offset Offset of the field in the data of the channel
+ *  @details The id of a field is the first slot of the field table, of the
+ *           TRACE_FIELD_PROBES from the hash of the channel and the offset,
+ *           that holds the field or is free, so a lookup reads at most that
+ *           many slots. A field that finds none gets TRACE_ID_NONE, and sets
+ *           TRACE_FULL_FIELDS in the header.
+ */
+void trace_field(unsigned type, const void *chan, unsigned offset);
+
+/** @brief Record a boot (main) */
+void trace_boot(unsigned boots);
+
+/** @brief Clear the trace
+ *  @details Plain writes: if the calling task is restarted, it clears the
+ *           events of its previous attempt too.
+ */
+void trace_clear();
+
+#endif
@@ -17,34 +17,71 @@
 #include "mutex.h"
 #include "thread.h"
 
+#ifdef LIBCHAIN_STATS
+#include "stats.h"
+#endif
+
 int mutex_init(mutex_t *m) {
     if (m == NULL) { return -1;}
-    m->free = 1;
-    m->holder = MAX_NUM_THREADS + 1; 
+    task_nv_write(&m->free, 1);
+    task_nv_write(&m->holder, MUTEX_NO_HOLDER);
+    task_nv_write(&m->waiters, 0);
+#ifdef LIBCHAIN_STATS
+    m->contention = 0;
+    stats_mutex_init(m);
+#endif
+#ifdef LIBCHAIN_TRACE
+    m->trace_id = trace_mutex_id(m);
+#endif
     return 0;
 }
 
 void mutex_lock(mutex_t *m) {
-    while (1) {
-        unsigned id = get_current(); 
-        LIBCHAIN_PRINTF("Holder id = %u Free = %u \r\n", m->holder, m->free); 
-        if (m->holder!=id && !m->free) {
-            LIBCHAIN_PRINTF("No lock for you! \r\n"); 
-            deschedule();
-        } else {
-            LIBCHAIN_PRINTF("Got lock!\r\n"); 
-            m->free = 0;
-            m->holder = id; 
-            break;
-        }
+    unsigned id = get_current(); 
+    LIBCHAIN_PRINTF("Holder id = %u Free = %u \r\n", m->holder, m->free); 
+    if (m->free) {
+        LIBCHAIN_PRINTF("Got lock!\r\n"); 
+        task_nv_write(&m->free, 0);
+        task_nv_write(&m->holder, id);
+    } else if (m->holder != id) {
+        LIBCHAIN_PRINTF("No lock for you! \r\n"); 
+#ifdef LIBCHAIN_STATS
+        m->contention++;
+#endif
+#ifdef LIBCHAIN_TRACE
+        trace_event(TRACE_MUTEX_WAIT, m->trace_id);
+#endif
+        thread_block_on(&m->waiters);
     }
+    // else: handed over to us by mutex_unlock while we were blocked
+
+#ifdef LIBCHAIN_TRACE
+    trace_event(TRACE_MUTEX_LOCK, m->trace_id);
+#endif
 }
 
 void mutex_unlock(mutex_t *m) {
+    thread_mask_t waiters = m->waiters;
     LIBCHAIN_PRINTF("Freeing lock!! \r\n"); 
-    m->free = 1;
+
+#ifdef LIBCHAIN_TRACE
+    trace_event(TRACE_MUTEX_UNLOCK, m->trace_id);
+#endif
+
+    if (!waiters) {
+        task_nv_write(&m->holder, MUTEX_NO_HOLDER);
+        task_nv_write(&m->free, 1);
+        return;
+    }
+
+    // Hand over: the mutex stays taken, with the next waiter as the holder
+    unsigned next = thread_mask_next(waiters, m->holder);
+    LIBCHAIN_PRINTF("Handing lock to %u \r\n", next); 
+    task_nv_write(&m->waiters, waiters & ~THREAD_MASK(next));
+    task_nv_write(&m->holder, next);
+    thread_wake(next);
 }
 
 void mutex_destroy(mutex_t *m) {
-    m->free = 0;
+    task_nv_write(&m->free, 0);
 }
@@ -0,0 +1,103 @@
+/** @file Implementation of queue channels
+ *
+ *  The indices count values and wrap around with the unsigned type: with a
+ *  power-of-two capacity, (index & (capacity - 1)) is the slot, and
+ *  tail - head the number of values, also across the wrap.
+ */
+#include <string.h>
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define LIBCHAIN_PRINTF(...)
+#else
+#include <stdio.h>
+#define LIBCHAIN_PRINTF printf
+#endif
+
+
+#include "queue.h"
+#include "thread.h"
+#include "arch.h"
+
+/** @brief Copy count values between the ring and a flat array
+ *  @details At most two memcpy calls: up to the end of the ring, and the
+ *           rest from its start.
+ */
+static void queue_copy(queue_t *q, uint8_t *buf, unsigned index,
+                       uint8_t *vals, unsigned count, int to_ring)
+{
+    unsigned slot = index & (q->capacity - 1);
+    unsigned first = q->capacity - slot;
+    size_t size = q->elem_size;
+
+    if (first > count)
+        first = count;
+
+    if (to_ring) {
+        memcpy(buf + slot * size, vals, first * size);
+        memcpy(buf, vals + first * size, (count - first) * size);
+    } else {
+        memcpy(vals, buf + slot * size, first * size);
+        memcpy(vals + first * size, buf, (count - first) * size);
+    }
+}
+
+/** @brief Halt on a request that no number of enqueues or dequeues can
+ *         satisfy, as the thread would block forever
+ */
+static void queue_check_count(queue_t *q, unsigned count)
+{
+    if (count > q->capacity) {
+        LIBCHAIN_PRINTF("queue: %u values requested, capacity %u in task %s\r\n",
+                        count, q->capacity, curctx->task->name);
+        ARCH_HALT("queue request larger than the queue capacity");
+    }
+}
+
+int queue_try_out(queue_t *q, void *buf, const void *vals, unsigned count) {
+    unsigned tail = q->tail;
+
+    if (q->capacity - (tail - q->head) < count)
+        return -1;
+
+    // The slots past the tail are free: fill them, then publish them
+    queue_copy(q, buf, tail, (uint8_t *)vals, count, 1);
+    task_nv_write(&q->tail, tail + count);
+
+    if (q->readers) {
+        thread_wake_set(q->readers);
+        task_nv_write(&q->readers, 0);
+    }
+    return 0;
+}
+
+int queue_try_in(queue_t *q, void *buf, void *vars, unsigned count) {
+    unsigned head = q->head;
+
+    if (q->tail - head < count)
+        return -1;
+
+    queue_copy(q, buf, head, vars, count, 0);
+    task_nv_write(&q->head, head + count);
+
+    if (q->writers) {
+        thread_wake_set(q->writers);
+        task_nv_write(&q->writers, 0);
+    }
+    return 0;
+}
+
+void queue_out(queue_t *q, void *buf, const void *vals, unsigned count) {
+    queue_check_count(q, count);
+    if (queue_try_out(q, buf, vals, count) < 0) {
+        LIBCHAIN_PRINTF("Queue full, blocking \r\n");
+        thread_block_on(&q->writers);
+    }
+}
+
+void queue_in(queue_t *q, void *buf, void *vars, unsigned count) {
+    queue_check_count(q, count);
+    if (queue_try_in(q, buf, vars, count) < 0) {
+        LIBCHAIN_PRINTF("Queue empty, blocking \r\n");
+        thread_block_on(&q->readers);
+    }
+}
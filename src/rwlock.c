@@ -0,0 +1,92 @@
+/** @file Implementation of intermittant reader-writer locks
+ *
+ *  As for mutexes, the lock is handed over to the threads it wakes up: they
+ *  are made holders before they run, and find themselves holding the lock
+ *  when their task is executed again.
+ */
+#include <stddef.h>
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define LIBCHAIN_PRINTF(...)
+#else
+#include <stdio.h>
+#define LIBCHAIN_PRINTF printf
+#endif
+
+
+#include "rwlock.h"
+#include "thread.h"
+
+int rwlock_init(rwlock_t *l) {
+    if (l == NULL) { return -1;}
+    task_nv_write(&l->readers, 0);
+    task_nv_write(&l->writer, RWLOCK_NO_WRITER);
+    task_nv_write(&l->read_waiters, 0);
+    task_nv_write(&l->write_waiters, 0);
+    return 0;
+}
+
+void rwlock_rdlock(rwlock_t *l) {
+    thread_mask_t self = THREAD_MASK(get_current());
+
+    if (l->readers & self)
+        return;
+
+    if (l->writer == RWLOCK_NO_WRITER && !l->write_waiters) {
+        task_nv_write(&l->readers, l->readers | self);
+    } else {
+        LIBCHAIN_PRINTF("Read lock busy, blocking \r\n");
+        thread_block_on(&l->read_waiters);
+    }
+}
+
+void rwlock_wrlock(rwlock_t *l) {
+    unsigned id = get_current();
+
+    if (l->writer == id)
+        return;
+
+    if (l->writer == RWLOCK_NO_WRITER && !l->readers) {
+        task_nv_write(&l->writer, id);
+    } else {
+        LIBCHAIN_PRINTF("Write lock busy, blocking \r\n");
+        thread_block_on(&l->write_waiters);
+    }
+}
+
+/** @brief Hand a lock that has just become free to the waiting threads */
+static void rwlock_handover(rwlock_t *l, unsigned id) {
+    thread_mask_t waiters = l->write_waiters;
+
+    if (waiters) {
+        unsigned next = thread_mask_next(waiters, id);
+        LIBCHAIN_PRINTF("Write lock to %u \r\n", next);
+        task_nv_write(&l->write_waiters, waiters & ~THREAD_MASK(next));
+        task_nv_write(&l->writer, next);
+        thread_wake(next);
+        return;
+    }
+
+    waiters = l->read_waiters;
+    if (waiters) {
+        LIBCHAIN_PRINTF("Read lock to %x \r\n", waiters);
+        task_nv_write(&l->read_waiters, 0);
+        task_nv_write(&l->readers, waiters);
+        thread_wake_set(waiters);
+    }
+}
+
+void rwlock_unlock(rwlock_t *l) {
+    unsigned id = get_current();
+    thread_mask_t readers = l->readers;
+
+    if (l->writer == id) {
+        task_nv_write(&l->writer, RWLOCK_NO_WRITER);
+        rwlock_handover(l, id);
+    } else if (readers & THREAD_MASK(id)) {
+        readers &= ~THREAD_MASK(id);
+        task_nv_write(&l->readers, readers);
+        if (!readers)
+            rwlock_handover(l, id);
+    }
+}
@@ -0,0 +1,55 @@
+/** @file Implementation of intermittant counting semaphores
+ *
+ *  A unit posted while threads wait is handed to one of them (the granted
+ *  set), instead of being added to the count: the woken thread re-executes
+ *  its task and must find its unit still there.
+ */
+#include <stddef.h>
+
+#ifndef LIBCHAIN_ENABLE_DIAGNOSTICS
+#define LIBCHAIN_PRINTF(...)
+#else
+#include <stdio.h>
+#define LIBCHAIN_PRINTF printf
+#endif
+
+
+#include "sem.h"
+#include "thread.h"
+
+int semaphore_init(semaphore_t *s, unsigned count) {
+    if (s == NULL) { return -1;}
+    task_nv_write(&s->count, count);
+    task_nv_write(&s->waiters, 0);
+    task_nv_write(&s->granted, 0);
+    return 0;
+}
+
+void semaphore_wait(semaphore_t *s) {
+    thread_mask_t self = THREAD_MASK(get_current());
+
+    if (s->granted & self) {
+        LIBCHAIN_PRINTF("Semaphore unit granted \r\n");
+        task_nv_write(&s->granted, s->granted & ~self);
+    } else if (s->count) {
+        task_nv_write(&s->count, s->count - 1);
+    } else {
+        LIBCHAIN_PRINTF("Semaphore empty, blocking \r\n");
+        thread_block_on(&s->waiters);
+    }
+}
+
+void semaphore_post(semaphore_t *s) {
+    thread_mask_t waiters = s->waiters;
+
+    if (!waiters) {
+        task_nv_write(&s->count, s->count + 1);
+        return;
+    }
+
+    unsigned next = thread_mask_next(waiters, get_current());
+    LIBCHAIN_PRINTF("Semaphore unit to %u \r\n", next);
+    task_nv_write(&s->waiters, waiters & ~THREAD_MASK(next));
+    task_nv_write(&s->granted, s->granted | THREAD_MASK(next));
+    thread_wake(next);
+}
@@ -0,0 +1,141 @@
+/** @file stats.c
+ *  @brief Runtime statistics, see stats.h
+ */
+
+#ifdef LIBCHAIN_STATS
+
+#include <stdio.h>
+
+#include "stats.h"
+
+extern volatile unsigned _numBoots;
+
+// Tasks that have run, by task index (see TASK)
+__nv task_t * volatile stats_tasks[sizeof(task_mask_t) * 8];
+
+__nv thread_stats_t thread_stats[MAX_NUM_THREADS];
+
+// Thread of the last task execution, to count switches
+__nv volatile unsigned stats_last_thread = 0;
+
+// Threads that blocked, and since when
+__nv volatile thread_mask_t stats_blocked_threads = 0;
+__nv volatile sched_time_t stats_blocked_since[MAX_NUM_THREADS];
+
+__nv mutex_t * volatile stats_mutexes[STATS_MAX_MUTEXES];
+__nv volatile unsigned stats_num_mutexes = 0;
+
+void stats_prologue(task_t *task, int restarted)
+{
+    unsigned id = curctx->thread;
+
+    if (restarted) {
+        task->stats.reexecutions++;
+        return;
+    }
+
+    task->stats.executions++;
+    if (stats_tasks[task->idx] != task)
+        stats_tasks[task->idx] = task;
+
+    if (id != stats_last_thread) {
+        thread_stats[id].switches++;
+        stats_last_thread = id;
+    }
+
+    if (stats_blocked_threads & THREAD_MASK(id)) {
+        thread_stats[id].blocked_time += thread_clock() - stats_blocked_since[id];
+        stats_blocked_threads &= ~THREAD_MASK(id);
+    }
+}
+
+void stats_blocked(unsigned id)
+{
+    task_nv_write(&stats_blocked_since[id], thread_clock());
+    task_nv_write(&stats_blocked_threads,
+                  stats_blocked_threads | THREAD_MASK(id));
+}
+
+void stats_mutex_init(mutex_t *m)
+{
+    unsigned i;
+
+    for (i = 0; i < stats_num_mutexes; ++i) {
+        if (stats_mutexes[i] == m)
+            return;
+    }
+
+    if (i < STATS_MAX_MUTEXES) {
+        stats_mutexes[i] = m;
+        stats_num_mutexes = i + 1;
+    }
+}
+
+const task_stats_t *stats_task(const task_t *task)
+{
+    return &task->stats;
+}
+
+const thread_stats_t *stats_thread(unsigned id)
+{
+    return &thread_stats[id];
+}
+
+stat_count_t stats_mutex_contention(const mutex_t *m)
+{
+    return m->contention;
+}
+
+unsigned stats_boots()
+{
+    return _numBoots;
+}
+
+void stats_dump()
+{
+    unsigned i;
+
+    printf("stats boots=%u\r\n", _numBoots);
+
+    for (i = 0; i < sizeof(task_mask_t) * 8; ++i) {
+        const task_t *task = stats_tasks[i];
+
+        if (!task)
+            continue;
+        printf("stats task=%s executions=%lu reexecutions=%lu "
+               "chan_out_bytes=%lu\r\n", task->name,
+               (unsigned long)task->stats.executions,
+               (unsigned long)task->stats.reexecutions,
+               (unsigned long)task->stats.chan_out_bytes);
+    }
+
+    for (i = 0; i < MAX_NUM_THREADS; ++i) {
+        printf("stats thread=%u switches=%lu blocked_time=%lu\r\n", i,
+               (unsigned long)thread_stats[i].switches,
+               (unsigned long)thread_stats[i].blocked_time);
+    }
+
+    for (i = 0; i < stats_num_mutexes; ++i) {
+        printf("stats mutex=%u contention=%lu\r\n", i,
+               (unsigned long)stats_mutexes[i]->contention);
+    }
+}
+
+void stats_reset()
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(task_mask_t) * 8; ++i) {
+        task_t *task = stats_tasks[i];
+
+        if (task)
+            memset(&task->stats, 0, sizeof(task->stats));
+    }
+
+    memset(thread_stats, 0, sizeof(thread_stats));
+
+    for (i = 0; i < stats_num_mutexes; ++i)
+        stats_mutexes[i]->contention = 0;
+}
+
+#endif // LIBCHAIN_STATS
@@ -2,6 +2,7 @@
  *  @brief Implementation of multi-threading functions
  */
 
+#include <limits.h>
 #include <stdarg.h>
 #include <string.h>
 
@@ -14,301 +15,525 @@
 
 #include "chain.h"
 #include "thread.h"
+#include "arch.h"
 
+#ifdef LIBCHAIN_STATS
+#include "stats.h"
+#endif
+
+
+// Slots of threads[] in use: created and not ended. Bit i corresponds to
+// threads[i]. Changes only in thread_create/thread_end, through the undo log,
+// so a restarted task never allocates or frees a slot twice.
+__nv volatile thread_mask_t thread_alloc = 0;
+
+// Threads that can be scheduled: created, not ended and not blocked.
+__nv volatile thread_mask_t thread_ready = 0;
+
+// Priority of each thread, see THREAD_PRIO_DEFAULT
+__nv volatile unsigned thread_prio[MAX_NUM_THREADS];
+
+// Quantum of each thread, 0 for THREAD_QUANTUM
+__nv volatile unsigned thread_quantum[MAX_NUM_THREADS];
+
+// Boundaries the current thread has run in its turn so far, minus one.
+// Written through the undo log, so it counts each boundary once.
+__nv volatile unsigned sched_slice = 0;
+
+// Generation of each slot, see THREAD_ID. Changes in thread_create, through
+// the undo log.
+__nv volatile unsigned thread_generation[MAX_NUM_THREADS];
+
+// Threads blocked in thread_join, indexed by the slot they wait for
+__nv volatile thread_mask_t thread_joiners[MAX_NUM_THREADS];
+
+// Joiners whose thread has ended, but that have not run since
+__nv volatile thread_mask_t thread_joined = 0;
+
+// Periodic threads (thread_create_periodic), indexed by slot. The period is
+// 0 for the other threads. Deadline and next release are absolute times.
+__nv volatile sched_time_t thread_period[MAX_NUM_THREADS];
+__nv volatile sched_time_t thread_rel_deadline[MAX_NUM_THREADS];
+__nv volatile sched_time_t thread_deadline[MAX_NUM_THREADS];
+__nv volatile sched_time_t thread_next_release[MAX_NUM_THREADS];
+__nv volatile unsigned thread_miss_count[MAX_NUM_THREADS];
+
+// Periodic threads that finished their job and wait for the next release
+__nv volatile thread_mask_t thread_waiting = 0;
+
+#if defined(LIBCHAIN_SCHED_PRIO) && defined(LIBCHAIN_SCHED_EDF)
+#error "LIBCHAIN_SCHED_PRIO and LIBCHAIN_SCHED_EDF are mutually exclusive"
+#endif
 
-// Current index in the free indicies array
-unsigned curr_free_index;
+/** @brief Wrap-around safe comparison of clock values */
+#define SCHED_TIME_BEFORE(a, b) ((int)((a) - (b)) < 0)
 
-typedef struct thread_state_t {
-    thread_t thread;
-    unsigned active;
-} thread_state_t;
+_Static_assert(MAX_NUM_THREADS <= sizeof(thread_mask_t) * 8,
+               "thread_mask_t too narrow for MAX_NUM_THREADS");
+_Static_assert(MAX_NUM_THREADS <= 1 << THREAD_ID_SLOT_BITS,
+               "THREAD_ID_SLOT_BITS too narrow for MAX_NUM_THREADS");
 
-struct thread_lib_fields {
-    // The current running thread
-    SELF_CHAN_FIELD(unsigned, current);
-};
+#define THREAD_MASK_ALL \
+    ((thread_mask_t)(((thread_mask_t)1 << (MAX_NUM_THREADS - 1)) * 2 - 1))
+
+static int thread_create_slot(task_t *new_task, unsigned prio);
+
+/** @brief Rotate a thread set right, so that slot 'shift' is at bit 0 */
+static thread_mask_t sched_rotate(thread_mask_t set, unsigned shift)
+{
+    if (!shift)
+        return set;
+    return ((set >> shift) | (set << (MAX_NUM_THREADS - shift))) &
+           THREAD_MASK_ALL;
+}
+
+#ifndef LIBCHAIN_HOST
+// Time that the default clock skipped while every thread was waiting
+static __nv volatile sched_time_t sched_idle_skipped = 0;
+#endif
+
+/** @brief Default time source of the scheduler, see thread_clock in thread.h
+ *  @details Microseconds on the host. On the device there is no timer the
+ *           library can assume, so logical time stands in for the clock
+ *           until the application provides its own thread_clock. Logical
+ *           time does not pass while the scheduler waits, so the default
+ *           thread_idle skips it ahead to the release.
+ */
+__attribute__((weak)) sched_time_t thread_clock()
+{
+#ifdef LIBCHAIN_HOST
+    return host_time_ns() / 1000;
+#else
+    return curctx->time + sched_idle_skipped;
+#endif
+}
+
+/** @brief Default idle hook, see thread_idle in thread.h
+ *  @details On the host the clock runs by itself. On the device, moves the
+ *           default clock to the release; a clock of the application is
+ *           polled until it gets there. Plain write: the clock never goes
+ *           back, also when the task is restarted.
+ */
+__attribute__((weak)) void thread_idle(sched_time_t until)
+{
+#ifdef LIBCHAIN_HOST
+    (void)until;
+#else
+    sched_time_t now = thread_clock();
 
-#define FIELD_INIT_thread_lib_fields {\
-    SELF_FIELD_INITIALIZER,\
+    if (SCHED_TIME_BEFORE(now, until))
+        sched_idle_skipped += until - now;
+#endif
 }
 
-struct thread_array {
-    // Array of thread information
-    CHAN_FIELD_ARRAY(thread_state_t, threads, MAX_NUM_THREADS);
-};
-
-struct indicies {
-    // Indexes of spots in the thread array that aren't in use
-    CHAN_FIELD_ARRAY(unsigned, free_indicies, MAX_NUM_THREADS);
-    // Size of the above array
-    CHAN_FIELD(unsigned, size);
-};
-
-unsigned get_current();
-static void set_current(unsigned current);
-
-
-// TODO - we should use a different #define so that the
-// scheduler task/channel symbols don't conflict and are easy to
-// access
-TASK(5, scheduler_task)
-
-// Broken self-channel for current
-SELF_CHANNEL(scheduler_task, thread_lib_fields);
-#define THREAD_FIELDS_CH (SELF_CH(scheduler_task))
-// Broken channel - all threads write, scheduler_task reads
-CHANNEL(task_global, scheduler_task, thread_array);
-#define THREAD_ARRAY_CH (CH(task_global, scheduler_task))
-// Broken channel - scheduler task defines free slots in threads[]
-CHANNEL(scheduler_task, task_global, indicies);
-#define INDICIES_CH (CH(scheduler_task, task_global))
-
-
-// Task to represent all tasks for "broken channels" - channels that any task
-// can read XOR write to
-void task_global() {
-    return;
+/** @details Rotate the set so that the thread after 'after' is at bit 0,
+ *           and count trailing zeros: a constant number of accesses to the
+ *           set regardless of the thread count.
+ */
+unsigned thread_mask_next(thread_mask_t set, unsigned after)
+{
+    unsigned shift = (after + 1) % MAX_NUM_THREADS;
+
+    return (shift + __builtin_ctz(sched_rotate(set, shift))) %
+           MAX_NUM_THREADS;
 }
 
+#if !defined(LIBCHAIN_SCHED_PRIO) && !defined(LIBCHAIN_SCHED_EDF)
 
+/** @brief Pick the first ready thread after 'current' in round-robin order */
+static unsigned sched_next_ready(thread_mask_t ready, unsigned current)
+{
+    return thread_mask_next(ready, current);
+}
 
-// Do all the things to run the scheduler
-void scheduler_task() {
-    task_prologue(); // Swap buffers for scheduler self_channel
-    LIBCHAIN_PRINTF("Inside scheduler task!! \r\n");
+#elif defined(LIBCHAIN_SCHED_PRIO)
 
-    // There's probably a better way to get an array into volatile memory
-    thread_state_t threads[MAX_NUM_THREADS];
-    unsigned indicies_size = 0;
-    for (unsigned i = 0; i < MAX_NUM_THREADS; i++) {
-        threads[i] = *CHAN_IN1(thread_state_t, threads[i], THREAD_ARRAY_CH);
-        // Set the indicies array to avoid two traversals
-        if (!threads[i].active) {
-            CHAN_OUT1(unsigned, free_indicies[indicies_size], i, INDICIES_CH);
-            indicies_size++;
+/** @brief Pick the ready thread with the highest effective priority
+ *  @details Visits the ready threads in round-robin order after 'current',
+ *           and keeps the first one with the highest priority, so equal
+ *           priorities still take turns. The age of a waiting thread comes
+ *           from the time of its resume context, so for a given ready set and
+ *           logical time the choice is always the same, also when the task
+ *           is restarted. The current thread has not waited at all.
+ */
+static unsigned sched_next_ready(thread_mask_t ready, unsigned current)
+{
+    unsigned shift = (current + 1) % MAX_NUM_THREADS;
+    thread_mask_t rotated = sched_rotate(ready, shift);
+    chain_time_t now = curctx->time;
+    unsigned best = current;
+    unsigned best_prio = 0;
+    int found = 0;
+
+    while (rotated) {
+        unsigned id = (shift + __builtin_ctz(rotated)) % MAX_NUM_THREADS;
+        unsigned prio = thread_prio[id];
+
+        rotated &= rotated - 1;
+
+        if (id != current) {
+            // In chain_time_t: a narrower type would be promoted to int and
+            // go negative when the clock wrapped while the thread waited
+            chain_time_t waited = (chain_time_t)(now - thread_resume_ctx[id]->time);
+            unsigned age = waited / THREAD_AGING;
+
+            prio += age < THREAD_AGING_MAX ? age : THREAD_AGING_MAX;
         }
-    }
-    curr_free_index = 0; 
-    // Write the size of the indicies array
-    CHAN_OUT1(unsigned, size, indicies_size, INDICIES_CH);
-    // Zero the current free index since we just wrote the scheduler array
-    curr_free_index = 0;
 
-    unsigned current = get_current();
-    
-    // Round robin - start with the next potentially schedulable thread
-    unsigned curr_idx = (current + 1) % MAX_NUM_THREADS;
-    LIBCHAIN_PRINTF("curr idx = %u \r\n",curr_idx); 
-    // Look for the next task to schedule
-    while (1) {
-        LIBCHAIN_PRINTF("threads[curr_idx]=%i active=%u \r\n",curr_idx,
-                        threads[curr_idx].active); 
-        if (threads[curr_idx].active) {
-            current = curr_idx;
-            break;
+        if (!found || prio > best_prio) {
+            best = id;
+            best_prio = prio;
+            found = 1;
         }
-        curr_idx = (curr_idx + 1) % MAX_NUM_THREADS;
     }
 
-    set_current(current);
-    thread_state_t curr_thread = threads[current];
+    return best;
+}
+
+#else // LIBCHAIN_SCHED_EDF
 
-    task_t *next_task = curr_thread.thread.context.task;
-    
-    transition_to(next_task);
+/** @brief Pick the ready thread whose job has the earliest deadline
+ *  @details Threads that are not periodic have no deadline and run only
+ *           when no periodic job is ready. Ties go round robin after
+ *           'current', as in the other policies.
+ */
+static unsigned sched_next_ready(thread_mask_t ready, unsigned current)
+{
+    unsigned shift = (current + 1) % MAX_NUM_THREADS;
+    thread_mask_t rotated = sched_rotate(ready, shift);
+    sched_time_t now = thread_clock();
+    unsigned best = current;
+    int best_left = 0;
+    int found = 0;
+
+    while (rotated) {
+        unsigned id = (shift + __builtin_ctz(rotated)) % MAX_NUM_THREADS;
+        // Time left until the deadline, negative once it has passed
+        int left = thread_period[id] ? (int)(thread_deadline[id] - now) :
+                                       INT_MAX;
+
+        rotated &= rotated - 1;
+
+        if (!found || left < best_left) {
+            best = id;
+            best_left = left;
+            found = 1;
+        }
+    }
+
+    return best;
 }
 
+#endif // LIBCHAIN_SCHED_EDF
 
-// Transition to the next task in the current thread
-void transition_to_mt(task_t *next_task){
-    LIBCHAIN_PRINTF("transition_to_mt \r\n");
-    thread_t next_thr;
-    thread_state_t next_thr_state;
-    context_t next_ctx;
-    unsigned current = get_current();
-    LIBCHAIN_PRINTF("Current = %u \r\n", current);
-
-    next_ctx.task = next_task;
-    next_ctx.time = curctx->time + 1;
-    LIBCHAIN_PRINTF("transition_to_mt next task = %x \r\n",next_ctx.task);
-    //Make thread_t to pass to scheduler
-    thread_state_t curr_thr = *CHAN_IN1(thread_state_t, threads[current],
-            THREAD_ARRAY_CH);
-    next_thr.thread_id = curr_thr.thread.thread_id;
-    next_thr.context = next_ctx;
-
-    //Write thread out to scheduler
-    next_thr_state.thread = next_thr;
-    next_thr_state.active = 1; // Hasn't called thread_end, still active
-
-    //Update context passed in
-    CHAN_OUT1(thread_state_t, threads[current], next_thr_state,
-            THREAD_ARRAY_CH);
-    TRANSITION_TO(scheduler_task);
+/** @brief Start the next job of the periodic thread in slot 'id'
+ *  @details The caller makes the thread ready. Through the undo log, so
+ *           that a restarted task does not release the same job twice.
+ */
+static void sched_release_job(unsigned id)
+{
+    sched_time_t release = thread_next_release[id];
+
+    task_nv_write(&thread_deadline[id], release + thread_rel_deadline[id]);
+    task_nv_write(&thread_next_release[id], release + thread_period[id]);
 }
 
-void swap_scheduler_buffer(void){
-  //So we don't have to keep calling TASK_REF...
-  task_t *curtask = TASK_REF(scheduler_task); 
-  // Minimize FRAM reads
-  self_field_meta_t **dirty_self_fields = curtask->dirty_self_fields;
-
-  int i;
-
-  // It is safe to repeat the loop for the same element, because the swap
-  // operation clears the dirty bit. We only need to be a little bit careful
-  // to decrement the count strictly after the swap.
-  while ((i = curtask->num_dirty_self_fields) > 0) {
-      self_field_meta_t *self_field = dirty_self_fields[--i];
-
-      if (self_field->idx_pair & SELF_CHAN_IDX_BIT_DIRTY_CURRENT) {
-          // Atomically: swap AND clear the dirty bit (by "moving" it over to MSB)
-          __asm__ volatile (
-              "SWPB %[idx_pair]\n"
-              : [idx_pair]  "=m" (self_field->idx_pair)
-          );
-      }
-
-      // Trade-off: either we do one FRAM write after each element, or
-      // we do only one write at the end (set to 0) but also not make
-      // forward progress if we reboot in the middle of this loop.
-      // We opt for making progress.
-      curtask->num_dirty_self_fields = i;
-  }
+/** @brief Make the waiting periodic threads whose release time has come
+ *         ready
+ *  @return The new ready set
+ *  @details If no thread is ready but some wait for their release, waits
+ *           for the earliest release, calling thread_idle until it is due.
+ */
+static thread_mask_t sched_release(void)
+{
+    thread_mask_t ready = thread_ready;
+    thread_mask_t waiting = thread_waiting;
+
+    while (waiting) {
+        sched_time_t now = thread_clock();
+        sched_time_t earliest = 0;
+        int found = 0;
+        thread_mask_t due = 0;
+        thread_mask_t pending = waiting;
+
+        while (pending) {
+            unsigned id = __builtin_ctz(pending);
+            sched_time_t release = thread_next_release[id];
+            pending &= pending - 1;
+
+            if (!SCHED_TIME_BEFORE(now, release)) {
+                sched_release_job(id);
+                due |= THREAD_MASK(id);
+            } else if (!found || SCHED_TIME_BEFORE(release, earliest)) {
+                earliest = release;
+                found = 1;
+            }
+        }
+
+        if (due) {
+            ready |= due;
+            task_nv_write(&thread_waiting, waiting & ~due);
+            task_nv_write(&thread_ready, ready);
+            break;
+        }
+
+        if (ready)
+            break;
+
+        thread_idle(earliest);
+    }
 
+    return ready;
 }
 
-/** @brief Setup the 0th index in the threads array to the current
- *         running thread, zero other elements of thread array,
- *         set current, initialize free indicies array & size
+/** @brief Finish the current task and continue with the next ready thread
+ *  @param next_task Task at which the current thread continues later
+ *  @details The decision depends only on the ready set, which a restarted
+ *           task sees unchanged (see task_nv_write), so it is the same on
+ *           every re-execution, and it takes effect with the context flip
+ *           in transition_to_thread, which also saves the continuation
+ *           of the current thread if it is switched out.
  */
-void thread_init() {
-    thread_state_t thread;
-    thread.thread.context = *curctx;
-    thread.thread.thread_id = 0;
-    thread.active = 1;
-    CHAN_OUT1(thread_state_t, threads[0], thread, THREAD_ARRAY_CH);
-
-    // Zero out non-volatile active bits (except current running thread)
-    for (unsigned i = 1; i < MAX_NUM_THREADS; i++) {
-        thread = *CHAN_IN1(thread_state_t, threads[i],
-                THREAD_ARRAY_CH);
-        thread.active = 0;
-        CHAN_OUT1(thread_state_t, threads[i], thread,
-                THREAD_ARRAY_CH);
+static void sched_switch(unsigned current, task_t *next_task)
+{
+    thread_mask_t ready = sched_release();
+
+    if (!ready) {
+        // Every thread has ended or is blocked: nothing can run again
+        LIBCHAIN_PRINTF("No ready threads \r\n");
+        if (thread_alloc)
+            ARCH_HALT("every remaining thread is blocked");
+        ARCH_END();
     }
 
-    // Setup free indicies array - all free except index 0
-    for (unsigned i = 1; i < MAX_NUM_THREADS; i++) {
-        CHAN_OUT1(unsigned, free_indicies[i-1], i, INDICIES_CH);
-        LIBCHAIN_PRINTF("Free= %i \r\n",i); 
+    // Round robin - start with the next potentially schedulable thread
+    unsigned next = sched_next_ready(ready, current);
+    LIBCHAIN_PRINTF("next thread = %u \r\n", next);
+#ifdef LIBCHAIN_TRACE
+    trace_event(TRACE_SCHED, next);
+#endif
+
+    // A new turn starts, for this thread or for the next one
+    if (sched_slice)
+        task_nv_write(&sched_slice, 0);
+
+    transition_to_thread(next_task, next);
+}
+
+
+// Transition to the next task in the current thread, letting other threads
+// run first once the thread has used up its quantum
+void transition_to_mt(task_t *next_task){
+    unsigned current = curctx->thread;
+    unsigned quantum = thread_quantum[current];
+    LIBCHAIN_PRINTF("transition_to_mt next task = %s \r\n", next_task->name);
+
+    if (!quantum)
+        quantum = THREAD_QUANTUM;
+
+    if (sched_slice + 1 < quantum && (thread_ready & THREAD_MASK(current))) {
+        task_nv_write(&sched_slice, sched_slice + 1);
+        transition_to_thread(next_task, current);
     }
 
-    // Set the size of the free indicies array
-    unsigned indicies_size = MAX_NUM_THREADS - 1;
-    CHAN_OUT1(unsigned, size, indicies_size, INDICIES_CH);
-    //Set the current thread to index 0
-    set_current(0);
-    swap_scheduler_buffer();  
-    
+    sched_switch(current, next_task);
+}
+
+/** @brief Reset the per-slot settings of a thread that is being created
+ *  @details Plain writes: nothing reads the settings of the slot before the
+ *           task transitions, and if it restarts, it resets them again.
+ */
+static void thread_slot_reset(unsigned slot, unsigned prio)
+{
+    thread_prio[slot] = prio;
+    thread_quantum[slot] = 0;
+    thread_joiners[slot] = 0;
+    thread_period[slot] = 0;
+    thread_miss_count[slot] = 0;
+}
+
+/** @brief Make the running thread the thread in slot 0, mark all other
+ *         slots free
+ *  @details The first task starts in the contexts of slot 0 and
+ *           transition_to keeps the slot, so they are set up already.
+ */
+void thread_init() {
+    thread_slot_reset(0, THREAD_PRIO_DEFAULT);
+    task_nv_write(&thread_waiting, 0);
+    task_nv_write(&thread_joined, 0);
+    task_nv_write(&thread_alloc, THREAD_MASK(0));
+    task_nv_write(&thread_ready, THREAD_MASK(0));
 }
 
 
 void thread_end() {
     unsigned current = get_current();
     LIBCHAIN_PRINTF("Ended thread %u \r\n", current); 
-    thread_state_t curr_thread = *CHAN_IN1(thread_state_t , threads[current],
-        THREAD_ARRAY_CH);
-    curr_thread.active = 0;
-    CHAN_OUT1(thread_state_t, threads[current], curr_thread,
-        THREAD_ARRAY_CH);
-    TRANSITION_TO(scheduler_task);
+    task_nv_write(&thread_ready, thread_ready & ~THREAD_MASK(current));
+    task_nv_write(&thread_alloc, thread_alloc & ~THREAD_MASK(current));
+
+    thread_mask_t joiners = thread_joiners[current];
+    if (joiners) {
+        task_nv_write(&thread_joiners[current], 0);
+        task_nv_write(&thread_joined, thread_joined | joiners);
+        thread_wake_set(joiners);
+    }
+
+    sched_switch(current, curctx->task);
 }
 
 
 int thread_create(task_t *new_task) {
-    unsigned indicies_size = *CHAN_IN1(unsigned, size, INDICIES_CH);
-    thread_state_t new_thread;
-    LIBCHAIN_PRINTF("Inside thread create!! new task = %x\r\n", new_task); 
-    unsigned new_thr_slot = *CHAN_IN1(unsigned, free_indicies[curr_free_index],
-                                      INDICIES_CH); 
-    LIBCHAIN_PRINTF("new_thr_slot = %u , curr_free= %u\r\n", new_thr_slot,curr_free_index); 
-    if (curr_free_index < indicies_size) {
-        
-        new_thread.thread.context.task = new_task;
-        // TODO Set to creation time instead of 0?
-        new_thread.thread.context.time = 0;
-        new_thread.thread.context.next_ctx = NULL;
-        
-        CHAN_OUT1(thread_state_t, threads[new_thr_slot], new_thread,
-            THREAD_ARRAY_CH);
-        curr_free_index++;
-    return 0;
-    }
-    
-    return -1;
+    return thread_create_prio(new_task, THREAD_PRIO_DEFAULT);
 }
 
-void deschedule() {
-    task_t *curr_task = curctx->task;
-    transition_to_mt(curr_task);
-}
 
-/***********************************************************
- * Interface to write to the scheduler's broken self channel
- ***********************************************************/
+int thread_create_prio(task_t *new_task, unsigned prio) {
+    int slot = thread_create_slot(new_task, prio);
 
-static void scheduler_chan_out(const char *field_name, const void *value,
-        size_t var_size, uint8_t *chan, size_t field_offset);
+    if (slot < 0)
+        return -1;
+    return THREAD_ID(slot, thread_generation[slot]);
+}
 
 
-#define SCHEDULER_CHAN_OUT(type, field, val, chan0) \
-    scheduler_chan_out(#field, &val, sizeof(VAR_TYPE(type)), \
-             (uint8_t *) chan0, offsetof(__typeof__(chan0->data), field))
+int thread_create_periodic(task_t *new_task, sched_time_t period,
+                           sched_time_t deadline) {
+    int slot = thread_create_slot(new_task, THREAD_PRIO_DEFAULT);
+    sched_time_t now = thread_clock();
 
+    if (slot < 0)
+        return -1;
 
-#define SCHEDULER_CHAN_IN(type, field, chan0) \
-    CHAN_IN1(type, field, chan0)
+    // The first job is released now
+    thread_period[slot] = period;
+    thread_rel_deadline[slot] = deadline;
+    thread_deadline[slot] = now + deadline;
+    thread_next_release[slot] = now + period;
+    return THREAD_ID(slot, thread_generation[slot]);
+}
 
 
-/** @brief Get the index of the current running thread in threads[]
+/** @brief Allocate a slot and set up the record of a new thread
+ *  @return The slot, or -1 if all slots are in use
  */
-unsigned get_current() {
-    return *SCHEDULER_CHAN_IN(unsigned, current, THREAD_FIELDS_CH);
+static int thread_create_slot(task_t *new_task, unsigned prio) {
+    thread_mask_t free_slots = ~thread_alloc & THREAD_MASK_ALL;
+    LIBCHAIN_PRINTF("Inside thread create!! new task = %s\r\n", new_task->name); 
+
+    if (!free_slots)
+        return -1;
+
+    // Lowest free slot. The contexts are set up before the slot is marked
+    // in use, so a half-created thread is never scheduled. A new thread
+    // starts aging at its creation.
+    unsigned new_thr_slot = __builtin_ctz(free_slots);
+    LIBCHAIN_PRINTF("new_thr_slot = %u\r\n", new_thr_slot); 
+
+    thread_context_init(new_thr_slot, new_task);
+    thread_slot_reset(new_thr_slot, prio);
+    task_nv_write(&thread_generation[new_thr_slot],
+                  (thread_generation[new_thr_slot] + 1) & THREAD_ID_GEN_MASK);
+    task_nv_write(&thread_alloc, thread_alloc | THREAD_MASK(new_thr_slot));
+    task_nv_write(&thread_ready, thread_ready | THREAD_MASK(new_thr_slot));
+    return new_thr_slot;
 }
 
+void thread_join(unsigned id) {
+    thread_mask_t self = THREAD_MASK(get_current());
+    unsigned slot = THREAD_ID_SLOT(id);
 
-/** @brief Set the index of the current running thread in threads[]
- */
-static void set_current(unsigned current) {
-    SCHEDULER_CHAN_OUT(unsigned, current, current, THREAD_FIELDS_CH);
+    // Woken up by thread_end: the slot may have been reused since
+    if (thread_joined & self) {
+        task_nv_write(&thread_joined, thread_joined & ~self);
+        return;
+    }
+
+    // Ended, and the slot is free or holds a later thread
+    if (!(thread_alloc & THREAD_MASK(slot)) ||
+        thread_generation[slot] != THREAD_ID_GEN(id))
+        return;
+
+    // Blocking rolls the task back, which would undo the creation as well
+    if (!(task_nv_initial(&thread_alloc) & THREAD_MASK(slot))) {
+        LIBCHAIN_PRINTF("thread_join: thread %u was created in task %s\r\n",
+                        slot, curctx->task->name);
+        ARCH_HALT("thread_join on a thread created by the joining task");
+    }
+
+    thread_block_on(&thread_joiners[slot]);
 }
 
+void deschedule() {
+    sched_switch(curctx->thread, curctx->task);
+}
 
-// Same as CHAN_OUT, but increments the number of dirty fields for
-// the scheduler
-static void scheduler_chan_out(const char *field_name, const void *value,
-    size_t var_size, uint8_t *chan, size_t field_offset) {
-    var_meta_t *var;
+void thread_block() {
+    thread_block_on(NULL);
+}
 
-    uint8_t *chan_data = chan + offsetof(CH_TYPE(_sa, _da, _void_type_t), data);
-    uint8_t *field = chan_data + field_offset;
+void thread_block_on(volatile thread_mask_t *waiters) {
+    task_rollback();
+    ARCH_POINT(HOST_POINT_BLOCK);
+    thread_suspend_on(waiters);
+}
 
-    self_field_meta_t *self_field = (self_field_meta_t *)field;
-    task_t *curtask = TASK_REF(scheduler_task);
+void thread_suspend_on(volatile thread_mask_t *waiters) {
+    unsigned current = curctx->thread;
 
-    unsigned var_offset =
-        (self_field->idx_pair & SELF_CHAN_IDX_BIT_NEXT) ? var_size : 0;
+    if (waiters)
+        task_nv_write(waiters, *waiters | THREAD_MASK(current));
+    task_nv_write(&thread_ready, thread_ready & ~THREAD_MASK(current));
+#ifdef LIBCHAIN_STATS
+    stats_blocked(current);
+#endif
+    sched_switch(current, curctx->task);
+}
 
-    var = (var_meta_t *)(field +
-            offsetof(SELF_FIELD_TYPE(void_type_t), var) + var_offset);
+void thread_wake(unsigned id) {
+    task_nv_write(&thread_ready, thread_ready | THREAD_MASK(id));
+}
 
-    self_field->idx_pair &= ~(SELF_CHAN_IDX_BIT_DIRTY_NEXT);
-    self_field->idx_pair |= SELF_CHAN_IDX_BIT_DIRTY_CURRENT;
-    curtask->dirty_self_fields[curtask->num_dirty_self_fields++] = self_field;
+void thread_wake_set(thread_mask_t set) {
+    if (set)
+        task_nv_write(&thread_ready, thread_ready | set);
+}
+
+void thread_wait_period(task_t *next_task) {
+    unsigned current = curctx->thread;
+    sched_time_t now = thread_clock();
+
+    if (!thread_period[current])
+        transition_to_mt(next_task);
+
+    if (SCHED_TIME_BEFORE(thread_deadline[current], now))
+        task_nv_write(&thread_miss_count[current],
+                      thread_miss_count[current] + 1);
+
+    if (!SCHED_TIME_BEFORE(now, thread_next_release[current])) {
+        // Overrun: the next job is already due, the thread stays ready
+        sched_release_job(current);
+    } else {
+        task_nv_write(&thread_waiting, thread_waiting | THREAD_MASK(current));
+        task_nv_write(&thread_ready, thread_ready & ~THREAD_MASK(current));
+#ifdef LIBCHAIN_STATS
+        stats_blocked(current);
+#endif
+    }
 
-    var->timestamp = curctx->time;
-    void *var_value = (uint8_t *)var + offsetof(VAR_TYPE(void_type_t), value);
-    memcpy(var_value, value, var_size - sizeof(var_meta_t));
+    sched_switch(current, next_task);
+}
+
+unsigned thread_misses(unsigned id) {
+    return thread_miss_count[THREAD_ID_SLOT(id)];
+}
+
+void thread_set_quantum(unsigned id, unsigned quantum) {
+    task_nv_write(&thread_quantum[THREAD_ID_SLOT(id)], quantum);
+}
+
+/** @brief Get the index of the current running thread in threads[]
+ */
+unsigned get_current() {
+    return curctx->thread;
 }
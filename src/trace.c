@@ -0,0 +1,158 @@
+/** @file trace.c
+ *  @brief Binary event trace, see trace.h
+ */
+
+#ifdef LIBCHAIN_TRACE
+
+#include "chain.h"
+#include "trace.h"
+
+_Static_assert((TRACE_SIZE & (TRACE_SIZE - 1)) == 0 && TRACE_SIZE <= 0x8000,
+               "TRACE_SIZE must be a power of two, at most 0x8000");
+_Static_assert(TRACE_MAX_MUTEXES < TRACE_ID_NONE &&
+               TRACE_MAX_FIELDS < TRACE_ID_NONE,
+               "the ids of mutexes and fields must fit in the event argument");
+_Static_assert((TRACE_MAX_FIELDS & (TRACE_MAX_FIELDS - 1)) == 0 &&
+               TRACE_FIELD_PROBES <= TRACE_MAX_FIELDS,
+               "TRACE_MAX_FIELDS must be a power of two, of at least "
+               "TRACE_FIELD_PROBES");
+
+__nv trace_buf_t trace_buf = {
+    { TRACE_MAGIC, TRACE_VERSION, TRACE_SIZE, 0, 0, sizeof(void *),
+      offsetof(task_t, name), TASK_NAME_SIZE, TRACE_MAX_MUTEXES,
+      TRACE_MAX_FIELDS,
+      offsetof(CH_TYPE(_sa, _da, _void_type_t), meta.diag.source_name),
+      CHAN_NAME_SIZE, 0, { 0 }, 0 },
+};
+
+void trace_event(unsigned type, unsigned arg)
+{
+    unsigned head = trace_buf.hdr.head;
+    volatile trace_event_t *ev = &trace_buf.events[head];
+
+    ev->info = TRACE_INFO(type, curctx->thread);
+    ev->arg = arg;
+    ev->time = curctx->time;
+
+    // A reboot before this line leaves the event to be overwritten
+    head = (head + 1) & (TRACE_SIZE - 1);
+    if (!head)
+        trace_buf.hdr.wrapped = 1;
+    trace_buf.hdr.head = head;
+}
+
+void trace_task(unsigned type, const void *task, unsigned idx)
+{
+    if (trace_buf.tasks[idx] != (uintptr_t)task)
+        trace_buf.tasks[idx] = (uintptr_t)task;
+    trace_event(type, idx);
+}
+
+static void trace_full(unsigned table)
+{
+    if (!(trace_buf.hdr.full & table))
+        trace_buf.hdr.full |= table;
+}
+
+unsigned trace_mutex_id(const void *mutex)
+{
+    unsigned i;
+
+    for (i = 0; i < TRACE_MAX_MUTEXES; ++i) {
+        if (trace_buf.mutexes[i] == (uintptr_t)mutex)
+            return i;
+        if (!trace_buf.mutexes[i]) {
+            trace_buf.mutexes[i] = (uintptr_t)mutex;
+            return i;
+        }
+    }
+
+    trace_full(TRACE_FULL_MUTEXES);
+    return TRACE_ID_NONE;
+}
+
+void trace_field(unsigned type, const void *chan, unsigned offset)
+{
+    // From the distance to the buffer, which trace_boot keeps when the
+    // image moves (on the host), so that a field keeps its slot
+    uintptr_t rel = (uintptr_t)chan - (uintptr_t)&trace_buf;
+    uint16_t key = (uint16_t)(rel >> 1) + (uint16_t)offset;
+    unsigned hash = (uint16_t)(key * 0x9e37U) >> 8;
+    unsigned n;
+
+    for (n = 0; n < TRACE_FIELD_PROBES; ++n) {
+        unsigned i = (hash + n) & (TRACE_MAX_FIELDS - 1);
+
+        if (trace_buf.fields[i] == (uintptr_t)chan &&
+            trace_buf.field_offsets[i] == offset) {
+            trace_event(type, i);
+            return;
+        }
+        if (!trace_buf.fields[i]) {
+            // The offset first: the id is taken once the channel is set
+            trace_buf.field_offsets[i] = offset;
+            trace_buf.fields[i] = (uintptr_t)chan;
+            trace_event(type, i);
+            return;
+        }
+    }
+
+    trace_full(TRACE_FULL_FIELDS);
+    trace_event(type, TRACE_ID_NONE);
+}
+
+var_meta_t *trace_chan_in(var_meta_t *var, const trace_source_t *sources,
+                          unsigned count)
+{
+    const trace_source_t *source = NULL;
+    unsigned i;
+
+    // The var lies in the field of its source, past the start of the field
+    // of any other source
+    for (i = 0; i < count; ++i) {
+        if ((uintptr_t)sources[i].field <= (uintptr_t)var &&
+            (!source || (uintptr_t)sources[i].field > (uintptr_t)source->field))
+            source = &sources[i];
+    }
+
+    if (source)
+        trace_field(TRACE_CHAN_IN, source->chan,
+                    source->field - source->data);
+    return var;
+}
+
+void trace_boot(unsigned boots)
+{
+    uintptr_t self = (uintptr_t)&trace_buf;
+    unsigned i;
+
+    // The image may be loaded at another address than in the last run
+    // (only on the host), keep the recorded addresses valid
+    if (trace_buf.hdr.self != self) {
+        uintptr_t old = trace_buf.hdr.self;
+
+        for (i = 0; old && i < TRACE_MAX_TASKS; ++i) {
+            if (trace_buf.tasks[i])
+                trace_buf.tasks[i] += self - old;
+        }
+        for (i = 0; old && i < TRACE_MAX_MUTEXES; ++i) {
+            if (trace_buf.mutexes[i])
+                trace_buf.mutexes[i] += self - old;
+        }
+        for (i = 0; old && i < TRACE_MAX_FIELDS; ++i) {
+            if (trace_buf.fields[i])
+                trace_buf.fields[i] += self - old;
+        }
+        trace_buf.hdr.self = self;
+    }
+
+    trace_event(TRACE_BOOT, boots);
+}
+
+void trace_clear()
+{
+    trace_buf.hdr.wrapped = 0;
+    trace_buf.hdr.head = 0;
+}
+
+#endif // LIBCHAIN_TRACE
@@ -0,0 +1,152 @@
+/** @file barrier.c
+ *  @brief Test: a barrier keeps threads in step, and thread_join waits for
+ *         the thread it was given, not for the slot
+ *
+ *  The thread of the entry task and WORKERS threads go through PHASES
+ *  phases, with a barrier between them: no thread may be more than one
+ *  phase ahead of another. The first thread then joins the workers, and
+ *  checks that they went through every phase.
+ *
+ *  Then it creates a thread A that ends right away, joins it, and creates
+ *  a thread B, which takes the slot of A and runs until it is released.
+ *  Joining A again must return at once, as A has ended: if it waited for B
+ *  instead, B gives up after SPINS boundaries and the check fails. Prints
+ *  one line,
+ *
+ *      barrier: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "barrier.h"
+
+#define WORKERS 3
+#define PHASES  500
+#define SPINS   1000
+
+TASK(1, task_init)
+TASK(2, task_work)
+TASK(3, task_sync)
+TASK(4, task_join_workers)
+TASK(5, task_join_a)
+TASK(6, task_create_b)
+TASK(7, task_join_a_again)
+TASK(8, task_join_b)
+TASK(9, task_a)
+TASK(10, task_b)
+
+__nv barrier_t b;
+__nv volatile unsigned workers[WORKERS];
+__nv volatile unsigned phase[MAX_NUM_THREADS];
+__nv volatile unsigned thread_a;
+__nv volatile unsigned thread_b;
+__nv volatile unsigned released;
+__nv volatile unsigned spins;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("barrier: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    barrier_init(&b, WORKERS + 1);
+    thread_init();
+    for (unsigned i = 0; i < WORKERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_work));
+    TRANSITION_TO_MT(task_work);
+}
+
+void task_work()
+{
+    unsigned id = get_current();
+
+    for (unsigned i = 0; i <= WORKERS; ++i)
+        if (phase[i] > phase[id] + 1 || phase[id] > phase[i] + 1)
+            fail("phases apart", phase[i], phase[id]);
+    task_nv_write(&phase[id], phase[id] + 1);
+    TRANSITION_TO_MT(task_sync);
+}
+
+void task_sync()
+{
+    unsigned id = get_current();
+
+    barrier_wait(&b);
+    if (phase[id] < PHASES)
+        TRANSITION_TO_MT(task_work);
+    if (id)
+        THREAD_END();
+    TRANSITION_TO_MT(task_join_workers);
+}
+
+void task_join_workers()
+{
+    // A join that blocks executes the task again: the workers that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i < WORKERS; ++i)
+        thread_join(workers[i]);
+
+    for (unsigned i = 0; i <= WORKERS; ++i)
+        if (phase[i] != PHASES)
+            fail("phases of a thread", phase[i], PHASES);
+
+    task_nv_write(&thread_a, THREAD_CREATE(task_a));
+    TRANSITION_TO_MT(task_join_a);
+}
+
+void task_join_a()
+{
+    thread_join(thread_a);
+    TRANSITION_TO_MT(task_create_b);
+}
+
+void task_create_b()
+{
+    task_nv_write(&thread_b, THREAD_CREATE(task_b));
+    if (THREAD_ID_SLOT(thread_b) != THREAD_ID_SLOT(thread_a))
+        fail("slot of B", THREAD_ID_SLOT(thread_b), THREAD_ID_SLOT(thread_a));
+    TRANSITION_TO_MT(task_join_a_again);
+}
+
+void task_join_a_again()
+{
+    thread_join(thread_a);
+    task_nv_write(&released, 1);
+    TRANSITION_TO_MT(task_join_b);
+}
+
+void task_join_b()
+{
+    thread_join(thread_b);
+    if (spins == SPINS)
+        fail("boundaries B ran without being released", spins, 0);
+
+    printf("barrier: ok\n");
+    exit(0);
+}
+
+void task_a()
+{
+    THREAD_END();
+}
+
+void task_b()
+{
+    if (released || spins == SPINS)
+        THREAD_END();
+    task_nv_write(&spins, spins + 1);
+    TRANSITION_TO_MT(task_b);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
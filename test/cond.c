@@ -0,0 +1,111 @@
+/** @file cond.c
+ *  @brief Test: condition variables wake their waiters, and discard the
+ *         task that waited
+ *
+ *  A ticker thread increments a tick count under a mutex and signals a
+ *  condition variable, TICKS times, then broadcasts. WAITERS threads each
+ *  wait under the mutex until the count differs from the last one they
+ *  saw. Before waiting, a waiter writes a marker, which cond_wait must roll
+ *  back with the rest of the task. The thread of the entry task joins the
+ *  others and checks that every waiter saw the last tick, and that no
+ *  marker survived. Prints one line,
+ *
+ *      cond: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+#include "cond.h"
+
+#define WAITERS 2
+#define TICKS   500
+
+TASK(1, task_init)
+TASK(2, task_tick)
+TASK(3, task_wait)
+TASK(4, task_join)
+
+__nv mutex_t m;
+__nv cond_t c;
+__nv volatile unsigned workers[WAITERS + 1];
+__nv volatile unsigned ticks;
+__nv volatile unsigned seen[MAX_NUM_THREADS];
+__nv volatile unsigned markers;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("cond: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    mutex_init(&m);
+    cond_init(&c);
+    thread_init();
+    task_nv_write(&workers[0], THREAD_CREATE(task_tick));
+    for (unsigned i = 1; i <= WAITERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_wait));
+    TRANSITION_TO_MT(task_join);
+}
+
+void task_tick()
+{
+    mutex_lock(&m);
+    task_nv_write(&ticks, ticks + 1);
+    cond_signal(&c);
+    mutex_unlock(&m);
+
+    if (ticks == TICKS) {
+        cond_broadcast(&c);
+        THREAD_END();
+    }
+    TRANSITION_TO_MT(task_tick);
+}
+
+void task_wait()
+{
+    unsigned id = get_current();
+
+    mutex_lock(&m);
+    if (seen[id] == ticks) {
+        task_nv_write(&markers, markers + 1);
+        cond_wait(&c, &m);
+    }
+    if (ticks < seen[id])
+        fail("tick count went back", ticks, seen[id]);
+    task_nv_write(&seen[id], ticks);
+    mutex_unlock(&m);
+
+    if (seen[id] == TICKS)
+        THREAD_END();
+    TRANSITION_TO_MT(task_wait);
+}
+
+void task_join()
+{
+    // A join that blocks executes the task again: the threads that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i <= WAITERS; ++i)
+        thread_join(workers[i]);
+
+    if (markers)
+        fail("markers written before cond_wait", markers, 0);
+    if (m.free != 1 || c.waiters)
+        fail("mutex free and no waiters at the end", m.free, 1);
+
+    printf("cond: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,149 @@
+/** @file global.c
+ *  @brief Test: global channels share state between threads, commit the
+ *         writes of a task together, and drop them if it is rolled back
+ *
+ *  WORKERS threads each add one to a shared total and to their own entry
+ *  of a per-thread array, ROUNDS times, reading their own writes back. Every
+ *  few rounds, a thread also rewrites all FIELDS entries of a wide array
+ *  from the value it reads in the first one: any task that reads the array
+ *  must see all entries equal. The updates are staged before locking a
+ *  mutex that the other threads hold across a task boundary, so that many
+ *  of them are discarded when the thread blocks. The thread of the entry
+ *  task joins the workers and checks the sums. Prints one line,
+ *
+ *      global: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+
+#define WORKERS     3
+#define ROUNDS      1000
+#define FIELDS      40
+#define WIDE_EVERY  4
+
+struct msg_shared {
+    GLOBAL_CHAN_FIELD(unsigned, total);
+    GLOBAL_CHAN_FIELD_ARRAY(unsigned, per, MAX_NUM_THREADS);
+    GLOBAL_CHAN_FIELD_ARRAY(unsigned, wide, FIELDS);
+};
+#define FIELD_INIT_msg_shared { \
+    GLOBAL_FIELD_INITIALIZER, \
+    GLOBAL_FIELD_ARRAY_INITIALIZER(MAX_NUM_THREADS), \
+    GLOBAL_FIELD_ARRAY_INITIALIZER(FIELDS), \
+}
+
+TASK(1, task_init)
+TASK(2, task_update)
+TASK(3, task_unlock)
+TASK(4, task_join)
+
+GLOBAL_CHANNEL(shared, msg_shared);
+
+#define CH_SHARED GLOBAL_CH(shared)
+
+__nv mutex_t m;
+__nv volatile unsigned workers[WORKERS];
+
+// Updates discarded by blocking, counted in volatile memory on purpose
+static unsigned discarded;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("global: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+/** @brief Check that all entries of the wide array are equal, return them */
+static unsigned wide_value(void)
+{
+    unsigned val = *CHAN_IN1(unsigned, wide[0], CH_SHARED);
+
+    for (unsigned i = 1; i < FIELDS; ++i) {
+        unsigned got = *CHAN_IN1(unsigned, wide[i], CH_SHARED);
+        if (got != val)
+            fail("entry of the wide array", got, val);
+    }
+    return val;
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    mutex_init(&m);
+    thread_init();
+    for (unsigned i = 0; i < WORKERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_update));
+    TRANSITION_TO_MT(task_join);
+}
+
+void task_update()
+{
+    unsigned id = get_current();
+    unsigned total = *CHAN_IN1(unsigned, total, CH_SHARED) + 1;
+    unsigned mine = *CHAN_IN1(unsigned, per[id], CH_SHARED) + 1;
+
+    CHAN_OUT1(unsigned, total, total, CH_SHARED);
+    CHAN_OUT1(unsigned, per[id], mine, CH_SHARED);
+    if (*CHAN_IN1(unsigned, total, CH_SHARED) != total)
+        fail("total read back", *CHAN_IN1(unsigned, total, CH_SHARED), total);
+
+    if (mine % WIDE_EVERY == 0) {
+        unsigned wide = wide_value() + 1;
+
+        for (unsigned i = 0; i < FIELDS; ++i)
+            CHAN_OUT1(unsigned, wide[i], wide, CH_SHARED);
+        if (wide_value() != wide)
+            fail("wide array read back", wide_value(), wide);
+    }
+
+    if (!m.free && m.holder != id)
+        ++discarded;
+    mutex_lock(&m);
+    TRANSITION_TO_MT(task_unlock);
+}
+
+void task_unlock()
+{
+    unsigned id = get_current();
+
+    mutex_unlock(&m);
+    if (*CHAN_IN1(unsigned, per[id], CH_SHARED) == ROUNDS)
+        THREAD_END();
+    TRANSITION_TO_MT(task_update);
+}
+
+void task_join()
+{
+    unsigned sum = 0;
+
+    // A join that blocks executes the task again: the workers that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i < WORKERS; ++i)
+        thread_join(workers[i]);
+
+    for (unsigned i = 0; i < MAX_NUM_THREADS; ++i)
+        sum += *CHAN_IN1(unsigned, per[i], CH_SHARED);
+    if (sum != WORKERS * ROUNDS)
+        fail("sum of the entries", sum, WORKERS * ROUNDS);
+    if (*CHAN_IN1(unsigned, total, CH_SHARED) != sum)
+        fail("total", *CHAN_IN1(unsigned, total, CH_SHARED), sum);
+    if (wide_value() != WORKERS * ROUNDS / WIDE_EVERY)
+        fail("wide array", wide_value(), WORKERS * ROUNDS / WIDE_EVERY);
+    if (!discarded)
+        fail("updates discarded by blocking", discarded, 1);
+
+    printf("global: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,105 @@
+/** @file mutex.c
+ *  @brief Test: a mutex keeps a two-task critical section exclusive, and
+ *         hands over to its waiters
+ *
+ *  WORKERS threads each increment a shared counter ROUNDS times: one task
+ *  locks the mutex and copies the counter, the next one writes the copy
+ *  plus one back and unlocks, so that an overlap loses an increment. The
+ *  workers contend for the mutex all the time, so most unlocks hand it over
+ *  to a blocked thread. The thread of the entry task joins the workers and
+ *  checks the counter. Prints one line,
+ *
+ *      mutex: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+
+#define WORKERS 3
+#define ROUNDS  1000
+
+TASK(1, task_init)
+TASK(2, task_lock)
+TASK(3, task_unlock)
+TASK(4, task_join)
+
+__nv mutex_t m;
+__nv volatile unsigned workers[WORKERS];
+__nv volatile unsigned counter;
+__nv volatile unsigned copy[MAX_NUM_THREADS];
+__nv volatile unsigned rounds[MAX_NUM_THREADS];
+__nv volatile unsigned inside;
+__nv volatile unsigned handoffs;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("mutex: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    mutex_init(&m);
+    thread_init();
+    for (unsigned i = 0; i < WORKERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_lock));
+    TRANSITION_TO_MT(task_join);
+}
+
+void task_lock()
+{
+    unsigned id = get_current();
+
+    mutex_lock(&m);
+    if (inside)
+        fail("threads in the critical section", inside + 1, 1);
+    task_nv_write(&inside, 1);
+    task_nv_write(&copy[id], counter);
+    TRANSITION_TO_MT(task_unlock);
+}
+
+void task_unlock()
+{
+    unsigned id = get_current();
+
+    task_nv_write(&counter, copy[id] + 1);
+    task_nv_write(&inside, 0);
+    task_nv_write(&rounds[id], rounds[id] + 1);
+    if (m.waiters)
+        task_nv_write(&handoffs, handoffs + 1);
+    mutex_unlock(&m);
+
+    if (rounds[id] == ROUNDS)
+        THREAD_END();
+    TRANSITION_TO_MT(task_lock);
+}
+
+void task_join()
+{
+    // A join that blocks executes the task again: the workers that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i < WORKERS; ++i)
+        thread_join(workers[i]);
+
+    if (counter != WORKERS * ROUNDS)
+        fail("counter", counter, WORKERS * ROUNDS);
+    if (!handoffs)
+        fail("unlocks that handed over", handoffs, 1);
+    if (m.free != 1 || m.waiters)
+        fail("mutex free at the end", m.free, 1);
+
+    printf("mutex: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
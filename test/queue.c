@@ -0,0 +1,142 @@
+/** @file queue.c
+ *  @brief Test: queue channels deliver every value once and in order
+ *
+ *  Two queues with fewer slots than values in flight, so that both sides
+ *  block. A producer thread enqueues 1, 2, ... VALUES one at a time, and a
+ *  consumer thread checks that it dequeues them in that order. A second
+ *  producer enqueues BATCH_VALUES values in batches of BATCH_OUT, and the
+ *  thread of the entry task dequeues them in batches of BATCH_IN, checking
+ *  the order, then joins the other threads and checks that both queues
+ *  are empty. Prints one line,
+ *
+ *      queue: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "queue.h"
+
+#define WORKERS      3
+#define VALUES       2000
+#define BATCH_VALUES 1500
+#define BATCH_OUT    3
+#define BATCH_IN     5
+
+_Static_assert(BATCH_VALUES % BATCH_OUT == 0 && BATCH_VALUES % BATCH_IN == 0,
+               "batches must add up to BATCH_VALUES");
+
+TASK(1, task_init)
+TASK(2, task_produce)
+TASK(3, task_consume)
+TASK(4, task_produce_batch)
+TASK(5, task_consume_batch)
+TASK(6, task_join)
+
+QUEUE_CHANNEL(task_produce, task_consume, unsigned, 4);
+QUEUE_CHANNEL(task_produce_batch, task_consume_batch, unsigned, 8);
+
+#define CH_SINGLE CH(task_produce, task_consume)
+#define CH_BATCH  CH(task_produce_batch, task_consume_batch)
+
+__nv volatile unsigned workers[WORKERS];
+__nv volatile unsigned produced;
+__nv volatile unsigned consumed;
+__nv volatile unsigned batch_produced;
+__nv volatile unsigned batch_consumed;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("queue: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    thread_init();
+    task_nv_write(&workers[0], THREAD_CREATE(task_produce));
+    task_nv_write(&workers[1], THREAD_CREATE(task_consume));
+    task_nv_write(&workers[2], THREAD_CREATE(task_produce_batch));
+    TRANSITION_TO_MT(task_consume_batch);
+}
+
+void task_produce()
+{
+    unsigned val = produced + 1;
+
+    QUEUE_OUT(unsigned, val, CH_SINGLE);
+    task_nv_write(&produced, val);
+
+    if (produced == VALUES)
+        THREAD_END();
+    TRANSITION_TO_MT(task_produce);
+}
+
+void task_consume()
+{
+    unsigned val;
+
+    QUEUE_IN(unsigned, val, CH_SINGLE);
+    if (val != consumed + 1)
+        fail("value dequeued", val, consumed + 1);
+    task_nv_write(&consumed, val);
+
+    if (consumed == VALUES)
+        THREAD_END();
+    TRANSITION_TO_MT(task_consume);
+}
+
+void task_produce_batch()
+{
+    unsigned vals[BATCH_OUT];
+
+    for (unsigned i = 0; i < BATCH_OUT; ++i)
+        vals[i] = batch_produced + 1 + i;
+    QUEUE_OUT_N(unsigned, vals, BATCH_OUT, CH_BATCH);
+    task_nv_write(&batch_produced, batch_produced + BATCH_OUT);
+
+    if (batch_produced == BATCH_VALUES)
+        THREAD_END();
+    TRANSITION_TO_MT(task_produce_batch);
+}
+
+void task_consume_batch()
+{
+    unsigned vals[BATCH_IN];
+
+    QUEUE_IN_N(unsigned, vals, BATCH_IN, CH_BATCH);
+    for (unsigned i = 0; i < BATCH_IN; ++i)
+        if (vals[i] != batch_consumed + 1 + i)
+            fail("value dequeued in a batch", vals[i], batch_consumed + 1 + i);
+    task_nv_write(&batch_consumed, batch_consumed + BATCH_IN);
+
+    if (batch_consumed == BATCH_VALUES)
+        TRANSITION_TO_MT(task_join);
+    TRANSITION_TO_MT(task_consume_batch);
+}
+
+void task_join()
+{
+    // A join that blocks executes the task again: the threads that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i < WORKERS; ++i)
+        thread_join(workers[i]);
+
+    if (consumed != VALUES)
+        fail("values dequeued", consumed, VALUES);
+    if (QUEUE_COUNT(CH_SINGLE) || QUEUE_COUNT(CH_BATCH))
+        fail("values left", QUEUE_COUNT(CH_SINGLE) + QUEUE_COUNT(CH_BATCH), 0);
+
+    printf("queue: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,118 @@
+/** @file rwlock.c
+ *  @brief Test: a reader-writer lock admits several readers or one writer
+ *
+ *  WORKERS threads each take the lock ROUNDS times, for writing every
+ *  WRITE_EVERY rounds (at a different round in each thread) and for
+ *  reading otherwise, and hold it across one task boundary. The tasks
+ *  count the readers and writers inside: a writer must be alone, and a
+ *  reader must not see a writer. The thread of the entry task joins the
+ *  workers, and checks that readers shared the lock at some point and that
+ *  the lock ends up free. Prints one line,
+ *
+ *      rwlock: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "rwlock.h"
+
+#define WORKERS     3
+#define ROUNDS      1000
+#define WRITE_EVERY 5
+
+TASK(1, task_init)
+TASK(2, task_lock)
+TASK(3, task_unlock)
+TASK(4, task_join)
+
+__nv rwlock_t l;
+__nv volatile unsigned workers[WORKERS];
+__nv volatile unsigned rounds[MAX_NUM_THREADS];
+__nv volatile unsigned readers;
+__nv volatile unsigned writers;
+__nv volatile unsigned max_readers;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("rwlock: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+static int writes(unsigned id)
+{
+    return rounds[id] % WRITE_EVERY == id % WRITE_EVERY;
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    rwlock_init(&l);
+    thread_init();
+    for (unsigned i = 0; i < WORKERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_lock));
+    TRANSITION_TO_MT(task_join);
+}
+
+void task_lock()
+{
+    unsigned id = get_current();
+
+    if (writes(id)) {
+        rwlock_wrlock(&l);
+        if (readers || writers)
+            fail("holders besides a writer", readers + writers, 0);
+        task_nv_write(&writers, 1);
+    } else {
+        rwlock_rdlock(&l);
+        if (writers)
+            fail("writers besides a reader", writers, 0);
+        task_nv_write(&readers, readers + 1);
+        if (readers > max_readers)
+            task_nv_write(&max_readers, readers);
+    }
+    TRANSITION_TO_MT(task_unlock);
+}
+
+void task_unlock()
+{
+    unsigned id = get_current();
+
+    if (writes(id))
+        task_nv_write(&writers, 0);
+    else
+        task_nv_write(&readers, readers - 1);
+    rwlock_unlock(&l);
+    task_nv_write(&rounds[id], rounds[id] + 1);
+
+    if (rounds[id] == ROUNDS)
+        THREAD_END();
+    TRANSITION_TO_MT(task_lock);
+}
+
+void task_join()
+{
+    // A join that blocks executes the task again: the workers that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i < WORKERS; ++i)
+        thread_join(workers[i]);
+
+    if (max_readers < 2)
+        fail("most readers at once", max_readers, WORKERS);
+    if (l.readers || l.writer != RWLOCK_NO_WRITER ||
+        l.read_waiters || l.write_waiters)
+        fail("holders and waiters at the end",
+             l.readers | l.read_waiters | l.write_waiters, 0);
+
+    printf("rwlock: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
@@ -0,0 +1,124 @@
+/** @file semaphore.c
+ *  @brief Test: counting semaphores bound a buffer shared by a producer
+ *         and several consumers
+ *
+ *  The classic bounded buffer: the producer takes an empty slot, stores
+ *  the next value and posts a full slot, the CONSUMERS take a full slot,
+ *  add its value to a sum and post an empty slot. The buffer has fewer
+ *  slots than there are threads, so that posts pass units directly to
+ *  blocked threads. Every task checks the number of occupied slots, and
+ *  the thread of the entry task joins the others and checks the sum.
+ *  Prints one line,
+ *
+ *      semaphore: ok
+ *
+ *  or the first failed check, and exits with a failure status on one.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+#include "thread.h"
+#include "mutex.h"
+#include "sem.h"
+
+#define CONSUMERS 2
+#define SLOTS     2
+#define VALUES    2000
+
+TASK(1, task_init)
+TASK(2, task_produce)
+TASK(3, task_consume)
+TASK(4, task_join)
+
+__nv semaphore_t empty;
+__nv semaphore_t full;
+__nv mutex_t m;
+__nv volatile unsigned workers[CONSUMERS + 1];
+__nv volatile unsigned buf[SLOTS];
+__nv volatile unsigned head;
+__nv volatile unsigned tail;
+__nv volatile unsigned occupied;
+__nv volatile unsigned produced;
+__nv volatile unsigned consumed;
+__nv volatile unsigned sum;
+
+static void fail(const char *what, unsigned got, unsigned want)
+{
+    printf("semaphore: %s: got %u, want %u\n", what, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    semaphore_init(&empty, SLOTS);
+    semaphore_init(&full, 0);
+    mutex_init(&m);
+    thread_init();
+    task_nv_write(&workers[0], THREAD_CREATE(task_produce));
+    for (unsigned i = 1; i <= CONSUMERS; ++i)
+        task_nv_write(&workers[i], THREAD_CREATE(task_consume));
+    TRANSITION_TO_MT(task_join);
+}
+
+void task_produce()
+{
+    semaphore_wait(&empty);
+    if (occupied >= SLOTS)
+        fail("occupied slots on produce", occupied, SLOTS - 1);
+    task_nv_write(&occupied, occupied + 1);
+    task_nv_write(&buf[head], produced + 1);
+    task_nv_write(&head, (head + 1) % SLOTS);
+    task_nv_write(&produced, produced + 1);
+    semaphore_post(&full);
+
+    if (produced == VALUES)
+        THREAD_END();
+    TRANSITION_TO_MT(task_produce);
+}
+
+void task_consume()
+{
+    if (consumed == VALUES)
+        THREAD_END();
+
+    semaphore_wait(&full);
+    mutex_lock(&m);
+    if (!occupied)
+        fail("occupied slots on consume", occupied, 1);
+    task_nv_write(&occupied, occupied - 1);
+    task_nv_write(&sum, sum + buf[tail]);
+    task_nv_write(&tail, (tail + 1) % SLOTS);
+    task_nv_write(&consumed, consumed + 1);
+    mutex_unlock(&m);
+    semaphore_post(&empty);
+
+    // Wake the other consumers for the last value, they end on their own
+    if (consumed == VALUES)
+        for (unsigned i = 1; i < CONSUMERS; ++i)
+            semaphore_post(&full);
+    TRANSITION_TO_MT(task_consume);
+}
+
+void task_join()
+{
+    // A join that blocks executes the task again: the threads that have
+    // ended by then are joined right away
+    for (unsigned i = 0; i <= CONSUMERS; ++i)
+        thread_join(workers[i]);
+
+    if (consumed != VALUES)
+        fail("consumed values", consumed, VALUES);
+    if (sum != (unsigned)VALUES * (VALUES + 1) / 2)
+        fail("sum", sum, (unsigned)VALUES * (VALUES + 1) / 2);
+
+    printf("semaphore: ok\n");
+    exit(0);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
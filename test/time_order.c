@@ -0,0 +1,147 @@
+/** @file time_order.c
+ *  @brief Test: channel reads return the latest write across the wrap
+ *         around of the logical time
+ *
+ *  Built with a 16-bit time and a short CHAIN_TIME_WINDOW (see the test
+ *  target of bld/host/Makefile), so that the time wraps around every few
+ *  rounds. Every round writes a source A, then a source B, waits a number
+ *  of transitions, so that both values are older than the window, and
+ *  checks that CHAN_IN2 returns the value of B with the sources in either
+ *  order. A write to a third channel takes the slot of the field in the
+ *  latest-writer index, so that the reads compare the timestamps.
+ *
+ *  The entry task also writes more vars than a table of stored times
+ *  would hold, and the last round reads them back. Prints one line,
+ *
+ *      time_order: ok
+ *
+ *  or the first mismatch, and exits with a failure status on a mismatch.
+ */
+
+#include <stdlib.h>
+
+#include "chain.h"
+
+#define ROUNDS      64
+#define MANY_FIELDS 200
+
+// Transitions between the writes and the check: around the window, and
+// the lengths that reordered two old values when the sweep clamped them to
+// a moving edge
+static const unsigned waits[] = { 1, 999, 1000, 1001, 5006, 5007, 9000 };
+#define NUM_WAITS (sizeof(waits) / sizeof(waits[0]))
+
+struct msg_x {
+    CHAN_FIELD(unsigned, x);
+};
+
+struct msg_many {
+    CHAN_FIELD_ARRAY(unsigned, v, MANY_FIELDS);
+};
+
+struct msg_state {
+    GLOBAL_CHAN_FIELD(unsigned, round);
+    GLOBAL_CHAN_FIELD(unsigned, left);
+};
+#define FIELD_INIT_msg_state { \
+    GLOBAL_FIELD_INITIALIZER, \
+    GLOBAL_FIELD_INITIALIZER, \
+}
+
+TASK(1, task_init)
+TASK(2, task_write_a)
+TASK(3, task_write_b)
+TASK(4, task_wait)
+TASK(5, task_check)
+
+CHANNEL(task_write_a, task_check, msg_x);
+CHANNEL(task_write_b, task_check, msg_x);
+CHANNEL(task_write_b, task_sink, msg_x);
+CHANNEL(task_init, task_check, msg_many);
+GLOBAL_CHANNEL(state, msg_state);
+
+#define CH_A CH(task_write_a, task_check)
+#define CH_B CH(task_write_b, task_check)
+
+static void fail(const char *what, unsigned round, unsigned got, unsigned want)
+{
+    printf("time_order: %s in round %u: got %u, want %u\n",
+           what, round, got, want);
+    exit(1);
+}
+
+void init()
+{
+}
+
+void task_init()
+{
+    for (unsigned i = 0; i < MANY_FIELDS; ++i) {
+        unsigned val = i * 3 + 1;
+        CHAN_OUT1(unsigned, v[i], val, CH(task_init, task_check));
+    }
+    TRANSITION_TO(task_write_a);
+}
+
+void task_write_a()
+{
+    unsigned round = *CHAN_IN1(unsigned, round, GLOBAL_CH(state));
+    unsigned val = 2 * round + 1;
+
+    CHAN_OUT1(unsigned, x, val, CH_A);
+    TRANSITION_TO(task_write_b);
+}
+
+void task_write_b()
+{
+    unsigned round = *CHAN_IN1(unsigned, round, GLOBAL_CH(state));
+    unsigned val = 2 * round + 2;
+    unsigned left = waits[round % NUM_WAITS];
+
+    CHAN_OUT1(unsigned, x, val, CH_B);
+    CHAN_OUT1(unsigned, x, val, CH(task_write_b, task_sink));
+    CHAN_OUT1(unsigned, left, left, GLOBAL_CH(state));
+    TRANSITION_TO(task_wait);
+}
+
+void task_wait()
+{
+    unsigned left = *CHAN_IN1(unsigned, left, GLOBAL_CH(state));
+
+    if (!left)
+        TRANSITION_TO(task_check);
+
+    --left;
+    CHAN_OUT1(unsigned, left, left, GLOBAL_CH(state));
+    TRANSITION_TO(task_wait);
+}
+
+void task_check()
+{
+    unsigned round = *CHAN_IN1(unsigned, round, GLOBAL_CH(state));
+    unsigned want = 2 * round + 2;
+    unsigned got;
+
+    got = *CHAN_IN2(unsigned, x, CH_A, CH_B);
+    if (got != want)
+        fail("CHAN_IN2(A, B)", round, got, want);
+    got = *CHAN_IN2(unsigned, x, CH_B, CH_A);
+    if (got != want)
+        fail("CHAN_IN2(B, A)", round, got, want);
+
+    if (++round == ROUNDS) {
+        for (unsigned i = 0; i < MANY_FIELDS; ++i) {
+            got = *CHAN_IN1(unsigned, v[i], CH(task_init, task_check));
+            if (got != i * 3 + 1)
+                fail("many fields", round, got, i * 3 + 1);
+        }
+        printf("time_order: ok\n");
+        exit(0);
+    }
+
+    CHAN_OUT1(unsigned, round, round, GLOBAL_CH(state));
+    TRANSITION_TO(task_write_a);
+}
+
+INIT_FUNC(init)
+ENTRY_TASK(task_init)
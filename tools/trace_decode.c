@@ -0,0 +1,288 @@
+/** @file trace_decode.c
+ *  @brief Print the event trace (LIBCHAIN_TRACE) found in a memory dump
+ *
+ *      trace_decode [-m] DUMP
+ *
+ *  DUMP is an image of the non-volatile memory that holds the trace buffer
+ *  and the task structures: a CHAIN_NV_FILE of a host run, or a raw dump of
+ *  the FRAM of a device. The buffer is found by its header (see trace.h),
+ *  and its events are printed oldest first, grouped into one timeline per
+ *  thread, or with -m merged into one, with a column for the thread. Task
+ *  names are read from the task structures in the dump, and fields are
+ *  shown as the names of the endpoints of their channel, also read from
+ *  the dump, and their offset in the data of the channel
+ *  (src->dest+offset). Mutexes are shown by their trace id. A mutex or a
+ *  field that got no id, as its table in the trace was full, is shown as
+ *  mutex#? or field#?.
+ *
+ *  Reboots are shown in the timeline of every thread, as they cut short
+ *  whatever each thread was doing. The dump must be little-endian, as are
+ *  the host and the MSP430.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define MAX_THREADS 16
+
+static const char * const type_names[TRACE_NUM_TYPES] = {
+    [TRACE_NONE]         = "none",
+    [TRACE_BOOT]         = "boot",
+    [TRACE_TASK_START]   = "start",
+    [TRACE_TASK_RESTART] = "restart",
+    [TRACE_SCHED]        = "sched",
+    [TRACE_CHAN_IN]      = "chan_in",
+    [TRACE_CHAN_OUT]     = "chan_out",
+    [TRACE_MUTEX_LOCK]   = "mutex_lock",
+    [TRACE_MUTEX_WAIT]   = "mutex_wait",
+    [TRACE_MUTEX_UNLOCK] = "mutex_unlock",
+};
+
+static uint8_t *dump;
+static size_t dump_size;
+static size_t buf_offset;
+static trace_header_t hdr;
+
+static uint64_t read_uint(size_t offset, unsigned size)
+{
+    uint64_t value = 0;
+
+    while (size--)
+        value = (value << 8) | dump[offset + size];
+    return value;
+}
+
+static int valid_header(size_t offset)
+{
+    trace_header_t h;
+
+    if (offset + sizeof(h) > dump_size)
+        return 0;
+    memcpy(&h, dump + offset, sizeof(h));
+
+    if (h.magic != TRACE_MAGIC || h.version != TRACE_VERSION)
+        return 0;
+    if (!h.size || (h.size & (h.size - 1)) || h.head >= h.size)
+        return 0;
+    if (h.ptr_size != 2 && h.ptr_size != 4 && h.ptr_size != 8)
+        return 0;
+
+    return offset + sizeof(h) +
+           (TRACE_MAX_TASKS + h.max_mutexes + h.max_fields) *
+           (size_t)h.ptr_size + h.max_fields * sizeof(uint16_t) +
+           h.size * sizeof(trace_event_t) <= dump_size;
+}
+
+static size_t fields_offset()
+{
+    return buf_offset + sizeof(hdr) +
+           (TRACE_MAX_TASKS + hdr.max_mutexes) * (size_t)hdr.ptr_size;
+}
+
+static size_t events_offset()
+{
+    return fields_offset() +
+           hdr.max_fields * ((size_t)hdr.ptr_size + sizeof(uint16_t));
+}
+
+static void read_event(unsigned i, trace_event_t *ev)
+{
+    size_t offset = events_offset() + i * sizeof(trace_event_t);
+
+    ev->info = dump[offset];
+    ev->arg = dump[offset + 1];
+    ev->time = read_uint(offset + 2, 2);
+}
+
+// Name of the task with the given index, from its task_t in the dump
+static const char *task_name(unsigned idx)
+{
+    static char name[256];
+    uint64_t addr = 0;
+    int64_t offset;
+
+    if (idx < TRACE_MAX_TASKS)
+        addr = read_uint(buf_offset + sizeof(hdr) + idx * hdr.ptr_size,
+                         hdr.ptr_size);
+
+    // The dump holds the header at buf_offset, and the task at the same
+    // distance from it as in memory
+    offset = (int64_t)buf_offset + (int64_t)(addr - hdr.self) + hdr.name_offset;
+    if (!addr || offset < 0 || (uint64_t)offset + hdr.name_size > dump_size) {
+        snprintf(name, sizeof(name), "task#%u", idx);
+        return name;
+    }
+
+    snprintf(name, sizeof(name), "%.*s", hdr.name_size,
+             (const char *)dump + offset);
+    return name;
+}
+
+// Endpoints of the channel and offset of the field with the given id
+static const char *field_name(unsigned id)
+{
+    static char name[256];
+    uint64_t addr = 0;
+    unsigned field_offset = 0;
+    int64_t offset;
+
+    if (id < hdr.max_fields) {
+        addr = read_uint(fields_offset() + id * hdr.ptr_size, hdr.ptr_size);
+        field_offset = read_uint(fields_offset() +
+                                 hdr.max_fields * hdr.ptr_size + id * 2, 2);
+    }
+
+    offset = (int64_t)buf_offset + (int64_t)(addr - hdr.self) +
+             hdr.chan_name_offset;
+    if (id == TRACE_ID_NONE) {
+        snprintf(name, sizeof(name), "field#?");
+        return name;
+    }
+    if (!addr || offset < 0 ||
+        (uint64_t)offset + 2 * hdr.chan_name_size > dump_size) {
+        snprintf(name, sizeof(name), "field#%u", id);
+        return name;
+    }
+
+    snprintf(name, sizeof(name), "%.*s->%.*s+%u",
+             hdr.chan_name_size, (const char *)dump + offset,
+             hdr.chan_name_size,
+             (const char *)dump + offset + hdr.chan_name_size, field_offset);
+    return name;
+}
+
+static void print_event(unsigned seq, const trace_event_t *ev, int merged)
+{
+    unsigned type = TRACE_INFO_TYPE(ev->info);
+
+    printf("  %6u  t=%-5u ", seq, ev->time);
+    if (merged)
+        printf(" thread %u  ", TRACE_INFO_THREAD(ev->info));
+    printf("%-12s ", type < TRACE_NUM_TYPES ? type_names[type] : "?");
+
+    switch (type) {
+        case TRACE_BOOT:
+            printf("%u", ev->arg);
+            break;
+        case TRACE_TASK_START:
+        case TRACE_TASK_RESTART:
+            printf("%s", task_name(ev->arg));
+            break;
+        case TRACE_SCHED:
+            printf("thread %u", ev->arg);
+            break;
+        case TRACE_CHAN_IN:
+        case TRACE_CHAN_OUT:
+            printf("%s", field_name(ev->arg));
+            break;
+        case TRACE_MUTEX_LOCK:
+        case TRACE_MUTEX_WAIT:
+        case TRACE_MUTEX_UNLOCK:
+            if (ev->arg == TRACE_ID_NONE)
+                printf("mutex#?");
+            else
+                printf("mutex#%u", ev->arg);
+            break;
+        default:
+            printf("%u", ev->arg);
+            break;
+    }
+    printf("\n");
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-m] DUMP\n", prog);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned first, count, i, thread;
+    unsigned thread_seen = 0;
+    int merged = 0;
+    FILE *f;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m")) != -1) {
+        if (opt == 'm')
+            merged = 1;
+        else
+            usage(argv[0]);
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    f = fopen(argv[optind], "rb");
+    if (!f || fseek(f, 0, SEEK_END) != 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    dump_size = ftell(f);
+    rewind(f);
+    dump = malloc(dump_size ? dump_size : 1);
+    if (!dump || fread(dump, 1, dump_size, f) != dump_size) {
+        perror(argv[optind]);
+        return 1;
+    }
+    fclose(f);
+
+    for (buf_offset = 0; buf_offset < dump_size; buf_offset += 2) {
+        if (valid_header(buf_offset))
+            break;
+    }
+    if (buf_offset >= dump_size) {
+        fprintf(stderr, "%s: no trace found\n", argv[optind]);
+        return 1;
+    }
+    memcpy(&hdr, dump + buf_offset, sizeof(hdr));
+
+    first = hdr.wrapped ? hdr.head : 0;
+    count = hdr.wrapped ? hdr.size : hdr.head;
+    printf("trace: %u events%s\n", count,
+           hdr.wrapped ? " (ring full, older ones overwritten)" : "");
+    if (hdr.full & TRACE_FULL_MUTEXES)
+        printf("trace: more than %u mutexes, some without an id\n",
+               hdr.max_mutexes);
+    if (hdr.full & TRACE_FULL_FIELDS)
+        printf("trace: field table full (%u), some fields without an id\n",
+               hdr.max_fields);
+
+    if (merged) {
+        for (i = 0; i < count; ++i) {
+            trace_event_t ev;
+
+            read_event((first + i) & (hdr.size - 1), &ev);
+            print_event(i, &ev, 1);
+        }
+        return 0;
+    }
+
+    for (i = 0; i < count; ++i) {
+        trace_event_t ev;
+
+        read_event((first + i) & (hdr.size - 1), &ev);
+        thread_seen |= 1U << TRACE_INFO_THREAD(ev.info);
+    }
+
+    for (thread = 0; thread < MAX_THREADS; ++thread) {
+        if (!(thread_seen & (1U << thread)))
+            continue;
+
+        printf("thread %u:\n", thread);
+        for (i = 0; i < count; ++i) {
+            trace_event_t ev;
+
+            read_event((first + i) & (hdr.size - 1), &ev);
+            if (TRACE_INFO_THREAD(ev.info) == thread ||
+                TRACE_INFO_TYPE(ev.info) == TRACE_BOOT)
+                print_event(i, &ev, 0);
+        }
+    }
+
+    return 0;
+}